@@ -0,0 +1,65 @@
+// Cycle counts.
+// Built with -DBENCH for riscv, as `make rvbench` does, fj reads the
+// cycle and retired-instruction counters at each change of phase:
+// setting up Global, tokenizing, executing, and freeing everything.
+// Only the outermost tokens switches between tokenizing and executing,
+// so a block run by a builtin counts as executing however many tokens
+// it reads.  The totals go to the UART at exit, and the machine is then
+// powered off so the run needs nobody to end it.
+// Elsewhere PHASE is nothing.
+#if defined(__riscv) && defined(BENCH)
+enum phase {PHINIT, PHTOKEN, PHEXEC, PHFREE, NPHASES};
+char* phasenames[NPHASES] = {"init", "tokenize", "execute", "free"};
+Word phasecycles[NPHASES], phaseinstrs[NPHASES];
+int phasenow = -1;
+Word phasecycle, phaseinstr; // Counters when phasenow began
+#define SIFIVETEST ((volatile unsigned int*) 0x100000) // qemu virt's test finisher
+
+// rdcycle - Word function
+static inline Word rdcycle() {
+    Word c;
+    __asm__ volatile ("rdcycle %0" : "=r" (c));
+    return c;
+}
+// rdinstret - Word function
+static inline Word rdinstret() {
+    Word c;
+    __asm__ volatile ("rdinstret %0" : "=r" (c));
+    return c;
+}
+// Charges the counts since the last switch to the phase that was
+// running, and starts p.  -1 just stops.
+// phase - void function
+void phase(int p) {
+    Word c = rdcycle(), i = rdinstret();
+    if (phasenow >= 0) {
+        phasecycles[phasenow] += c - phasecycle;
+        phaseinstrs[phasenow] += i - phaseinstr;
+    }
+    phasenow = p;
+    phasecycle = rdcycle();
+    phaseinstr = rdinstret();
+}
+// printcount - void function
+void printcount(unsigned long long n) {
+    if (n >= 10) {printcount(n / 10);}
+    putchar('0' + n % 10);
+}
+// Prints a line per phase, then powers off.
+// benchfinish - void function
+void benchfinish() {
+    phase(-1);
+    for (int i = 0; i < NPHASES; i++) {
+        printf("bench %s cycles ", phasenames[i]);
+        printcount(phasecycles[i]);
+        printf(" instret ");
+        printcount(phaseinstrs[i]);
+        printf("\n");
+    }
+    *SIFIVETEST = 0x5555;
+    while (1) {}
+}
+#define PHASE(p) phase(p)
+#else
+#define PHASE(p)
+#endif
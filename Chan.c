@@ -0,0 +1,127 @@
+// Channels.
+// A bounded ring of atoms, shared by every chans atom duplicated from the
+// one `chan` made.  It's the lock-free multi-producer multi-consumer ring
+// with a sequence number per cell: a cell is free for the send at
+// position p when its sequence is p, and holds the value for the recv at
+// p when it is p+1.  Senders and receivers only contend on their own
+// index, so it stays correct with threads on several OS threads, though
+// the interpreter only runs one today.
+// A channel is poisoned with the error of whatever was sending down it,
+// such as a pipeline stage that failed; recv fails with that error once
+// the atoms sent before it are taken.
+#include <stdatomic.h>
+
+typedef struct Cell Cell;
+struct Cell {
+    atomic_ulong seq;
+    Atom* a;
+};
+struct Chan {
+    atomic_long refs; // chans atoms sharing it, plus parked threads
+    unsigned long mask;
+    char* error; // Why its sender failed, or 0
+    atomic_ulong head, tail; // Positions of the next recv and send
+    Cell cells[];
+};
+
+#define MAXCHAN 0x1000000 // Most atoms a channel holds
+
+Atom* del(Atom* a);
+int chlen(char* c);
+// Makes a channel holding at least len atoms, at most MAXCHAN, or 0 if
+// there's no memory for it.  The ring needs two cells to tell a full
+// cell from a free one.
+// newchan - Chan* function
+Chan* newchan(Word len) {
+    unsigned long n = 2;
+    while (n < len) {n *= 2;}
+    Chan* c = malloc(sizeof(Chan) + n*sizeof(Cell));
+    if (!c) {return 0;}
+    atomic_init(&c->refs, 1);
+    c->mask = n - 1;
+    c->error = 0;
+    atomic_init(&c->head, 0);
+    atomic_init(&c->tail, 0);
+    for (unsigned long i = 0; i < n; i++) {atomic_init(&c->cells[i].seq, i);}
+    return c;
+}
+// chanref - Chan* function
+Chan* chanref(Chan* c) {
+    atomic_fetch_add_explicit(&c->refs, 1, memory_order_relaxed);
+    return c;
+}
+// Adds a to the channel, taking over the reference to it.
+// False if the channel is full.
+// chansend - bool function
+bool chansend(Chan* c, Atom* a) {
+    unsigned long pos = atomic_load_explicit(&c->tail, memory_order_relaxed);
+    while (true) {
+        Cell* cell = &c->cells[pos & c->mask];
+        long dif = (long) (atomic_load_explicit(&cell->seq, memory_order_acquire) - pos);
+        if (dif < 0) {return false;}
+        if (dif > 0) {pos = atomic_load_explicit(&c->tail, memory_order_relaxed); continue;}
+        if (atomic_compare_exchange_weak_explicit(&c->tail, &pos, pos + 1, memory_order_relaxed, memory_order_relaxed)) {
+            cell->a = a;
+            atomic_store_explicit(&cell->seq, pos + 1, memory_order_release);
+            return true;
+        }
+    }
+}
+// Takes the oldest atom in the channel with its reference, or 0 if it's
+// empty.
+// chanrecv - Atom* function
+Atom* chanrecv(Chan* c) {
+    unsigned long pos = atomic_load_explicit(&c->head, memory_order_relaxed);
+    while (true) {
+        Cell* cell = &c->cells[pos & c->mask];
+        long dif = (long) (atomic_load_explicit(&cell->seq, memory_order_acquire) - (pos + 1));
+        if (dif < 0) {return 0;}
+        if (dif > 0) {pos = atomic_load_explicit(&c->head, memory_order_relaxed); continue;}
+        if (atomic_compare_exchange_weak_explicit(&c->head, &pos, pos + 1, memory_order_relaxed, memory_order_relaxed)) {
+            Atom* a = cell->a;
+            atomic_store_explicit(&cell->seq, pos + c->mask + 1, memory_order_release);
+            return a;
+        }
+    }
+}
+// True if a send would succeed right now.
+// chanroom - bool function
+bool chanroom(Chan* c) {
+    unsigned long pos = atomic_load_explicit(&c->tail, memory_order_relaxed);
+    return atomic_load_explicit(&c->cells[pos & c->mask].seq, memory_order_acquire) == pos;
+}
+// True if a recv would succeed right now.
+// chanready - bool function
+bool chanready(Chan* c) {
+    unsigned long pos = atomic_load_explicit(&c->head, memory_order_relaxed);
+    return atomic_load_explicit(&c->cells[pos & c->mask].seq, memory_order_acquire) == pos + 1;
+}
+// True if a recv would fail: the channel is empty and poisoned.
+// chanfailed - bool function
+bool chanfailed(Chan* c) {return c->error && !chanready(c);}
+// True if something besides the one asking holds c.
+// chanshared - bool function
+bool chanshared(Chan* c) {return atomic_load_explicit(&c->refs, memory_order_acquire) > 1;}
+// Keeps the first error it's poisoned with.
+// chanpoison - void function
+void chanpoison(Chan* c, char* msg) {
+    if (c->error) {return;}
+    int len = chlen(msg);
+    c->error = malloc(len+1);
+    cpymem(c->error, msg, len+1);
+}
+// Atoms in the channel.
+// chanlen - Word function
+Word chanlen(Chan* c) {
+    return atomic_load(&c->tail) - atomic_load(&c->head);
+}
+// Drops a reference, freeing the channel and what's left in it with the
+// last one.
+// chanrelease - void function
+void chanrelease(Chan* c) {
+    if (!c || atomic_fetch_sub_explicit(&c->refs, 1, memory_order_acq_rel) != 1) {return;}
+    Atom* a;
+    while ((a = chanrecv(c))) {del(a);}
+    if (c->error) {reclaim(c->error, chlen(c->error)+1);}
+    reclaim(c, sizeof(Chan) + (c->mask + 1)*sizeof(Cell));
+}
@@ -0,0 +1,98 @@
+// Files.
+// `path mode open.` opens a file and leaves a handle, a word naming a
+// slot in a fixed table, as a file descriptor would.  Writes collect in
+// a FILEBUF buffer and reach the file in one write when it fills, on
+// `flush` or `close`, or at exit.  The mode is "w" to truncate or "a" to
+// append, where each of those writes lands at the end of the file even
+// with other writers; an "s" after either also fsyncs on every flush.
+// appendfile goes through the same table, keeping the file it appends
+// to open by its path, so a loop appending to a log costs a copy into
+// the buffer rather than an open and a close per call.  Anything else
+// that opens a path flushes the handles on it first.
+#ifndef __riscv
+#include <unistd.h>
+#endif
+#define MAXFILES 0x40
+#define FILEBUF 0x10000
+
+typedef struct Fhandle Fhandle;
+struct Fhandle {
+    FILE* fp;   // 0 when the slot is free
+    char* path;
+    char* buf;
+    bool sync;  // fsync on every flush
+    bool kept;  // Opened by appendfile, and closed to make room
+};
+Fhandle files[MAXFILES];
+
+int chlen(char* c);
+bool equstr(char* a, char* b);
+// fileflush - bool function
+bool fileflush(Fhandle* h) {
+    if (fflush(h->fp)) {return false;}
+#ifndef __riscv
+    if (h->sync && fsync(fileno(h->fp))) {return false;}
+#endif
+    return true;
+}
+// fileclose - bool function
+bool fileclose(Fhandle* h) {
+    bool ok = fileflush(h);
+    ok = !fclose(h->fp) && ok;
+    reclaim(h->path, chlen(h->path)+1);
+    reclaim(h->buf, FILEBUF);
+    *h = (Fhandle) {0};
+    return ok;
+}
+// Handle of the file at path opened with mode, or -1.  A handle kept by
+// appendfile is closed if there's no free slot.
+// fileopen - int function
+int fileopen(char* path, char* mode, bool kept) {
+    if ((mode[0] != 'w' && mode[0] != 'a') || (mode[1] && (mode[1] != 's' || mode[2]))) {return -1;}
+    int i = 0;
+    while (i < MAXFILES && files[i].fp) {i++;}
+    if (i == MAXFILES) {
+        for (i = 0; i < MAXFILES && !files[i].kept; i++) {}
+        if (i == MAXFILES) {return -1;}
+        fileclose(&files[i]);
+    }
+    char m[] = {mode[0], 0};
+    FILE* fp = fopen(path, m);
+    if (!fp) {return -1;}
+    int len = chlen(path);
+    Fhandle* h = &files[i];
+    *h = (Fhandle) {fp, malloc(len+1), malloc(FILEBUF), mode[1] == 's', kept};
+    cpymem(h->path, path, len+1);
+    setvbuf(fp, h->buf, _IOFBF, FILEBUF);
+    return i;
+}
+// The open file named by handle w, or 0.
+// filehandle - Fhandle* function
+Fhandle* filehandle(Word w) {
+    if (w < 0 || w >= MAXFILES || !files[w].fp) {return 0;}
+    return &files[w];
+}
+// Handle appendfile keeps on path, or -1.
+// keptfile - int function
+int keptfile(char* path) {
+    for (int i = 0; i < MAXFILES; i++) {
+        if (files[i].kept && equstr(files[i].path, path)) {return i;}
+    }
+    return -1;
+}
+// Flushes every handle on path, so what was written to it can be read.
+// flushpath - void function
+void flushpath(char* path) {
+    for (int i = 0; i < MAXFILES; i++) {
+        if (files[i].fp && equstr(files[i].path, path)) {fileflush(&files[i]);}
+    }
+}
+// Flushes every handle, for an abort that would drop their buffers.
+// flushfiles - void function
+void flushfiles() {
+    for (int i = 0; i < MAXFILES; i++) {if (files[i].fp) {fileflush(&files[i]);}}
+}
+// closefiles - void function
+void closefiles() {
+    for (int i = 0; i < MAXFILES; i++) {if (files[i].fp) {fileclose(&files[i]);}}
+}
@@ -1,9 +1,16 @@
 #include <stdlib.h>
 #include "Vect.c"
 #include <stdio.h>
+#ifndef __riscv
+#include <time.h>
+#include <poll.h>
+#endif
 
 typedef long long Word;
 typedef struct Vect Vect;
+typedef struct Chan Chan;
+typedef struct Rope Rope;
+typedef struct Slice Slice;
 typedef struct Atom Atom;
 typedef union data data;
 typedef enum form form;
@@ -14,6 +21,9 @@ union data {
     Word w;
     Func f;
     Vect* v;
+    Chan* c;
+    Rope* p;
+    Slice* s;
     Atom* a;
 };
 enum form {
@@ -23,6 +33,9 @@ enum form {
     words, // literal number value
     funcs, // pointer to a c function
     vects, // pointer to a dynamic array (a string)
+    chans, // pointer to a channel, shared with its duplicates
+    ropes, // pointer to a rope, a string being built by `cat`
+    slices, // pointer to a slice, a string sharing another's bytes
     dots,  // indicates this is a `..` object, signaling execution
     ends   // structural only.  Placeholder type pointed to by empty `atoms`
 };
@@ -30,10 +43,18 @@ enum form {
 struct Atom {
     Atom* n;
     data d;
-    form f;  // shape of s;
-    short r; // reference counter
+    form f : 8; // shape of s;
     bool e;  // 'end'.  True means n points to the parent
+    byte m;  // mark bits, below
+    int r;   // reference counter.  Frozen atoms can have any number of holders
 };
+#define HASHED 0x01 // covered by a cached shape hash
+#define FROZEN 0x02 // interned by freeze, never changes
+#define BUFFERED 0x04 // held as a possible root by the cycle collector
+#define COLOR 0x18 // cycle collector color, black when clear
+#define GRAY 0x08
+#define WHITE 0x10
+#define DOOMED 0x18
 
 struct Error {
     data d;
@@ -43,21 +64,77 @@ struct Error {
 Atom* Global;
 Atom* Threads;
 
+#include "builtins.c"
+// Set once a builtin's name shows up as a string the program made, after
+// which lookups have to scan for a binding of it before using the table.
+bool shadowed[NBUILTINS];
+// Index of the builtin named by the len bytes at c, or -1.
+// builtinbytes - int function
+int builtinbytes(byte* c, int len) {
+    if (len > BUILTINMAXLEN) {return -1;}
+    unsigned h = BUILTINSEED;
+    for (int j = 0; j < len; j++) {h = (h ^ (unsigned char) c[j]) * 16777619u;}
+    int i = builtinslots[h & (BUILTINSLOTS - 1)] - 1;
+    if (i < 0) {return -1;}
+    const char* n = builtinnames[i];
+    for (int j = 0; j < len; j++) {if (n[j] != c[j]) {return -1;}}
+    return n[len] ? -1 : i;
+}
+// Index of the builtin named c, or -1.
+// builtinindex - int function
+int builtinindex(char* c) {
+    int len = 0;
+    for (; c[len]; len++) {if (len == BUILTINMAXLEN) {return -1;}}
+    return builtinbytes(c, len);
+}
+// Marks the builtin named by the len bytes at c as shadowed.  Builtins
+// that make strings out of other bytes, as cat and split do, pass them
+// here, since the program may bind the name it spells.  The tokenizer's
+// own slices of names aren't, or every builtin used would be shadowed.
+// shadowbytes - void function
+void shadowbytes(byte* c, int len) {
+    int i = builtinbytes(c, len);
+    if (i >= 0) {shadowed[i] = true;}
+}
+// Name of the builtin calling f, or 0.
+// builtinname - const char* function
+const char* builtinname(Func f) {
+    for (int i = 0; i < NBUILTINS; i++) {
+        if (builtinatoms[i].d.f == f) {return builtinnames[i];}
+    }
+    return 0;
+}
+#include "Trace.c"
+#include "Bench.c"
+#include "Chan.c"
+#include "Rope.c"
+#include "Slice.c"
+#include "File.c"
+
 Word  asW(Atom* a) {return (a && a->f == words) ? a->d.w : 0;}
 Func  asF(Atom* a) {return (a && a->f == funcs) ? a->d.f : 0;}
-Vect* asV(Atom* a) {return (a && a->f == vects) ? a->d.v : 0;}
+void flatten(Atom* a);
+Vect* asV(Atom* a) {
+    if (a && (a->f == ropes || a->f == slices)) {flatten(a);}
+    return (a && a->f == vects) ? a->d.v : 0;
+}
+Chan* asC(Atom* a) {return (a && a->f == chans) ? a->d.c : 0;}
 bool  isA(Atom* a) {return (a->f == atoms || a->f == links || a->f == execs);}
 Atom* asA(Atom* a) {return (a && isA(a)) ? a->d.a : 0;}
+bool  isfrozen(Atom* a) {return a && (a->m & FROZEN);}
 
 Error pass(data d)    {return (Error) {d, 0};}
 Error passA(Atom* a)  {return (Error) {(data) a, 0};}
 Atom* str(char* c);
 Atom* addstrch(Atom* s, char* c);
 Atom* addstr(Atom* s1, Atom* s2);
-Atom* inttostr(int a, int b);
+Atom* inttostr(Word n, int b);
+Atom* ref(Atom* a);
+// The message is held once, so whoever handles the error frees it with
+// del.
 Error makeErr(char* msg, Word line) {
-    Atom* s = str("\e[4mError on line: ");
-    addstr(s, inttostr(line, 10));
+    Atom* s = ref(str("\e[4mError on line: "));
+    addstr(s, ref(inttostr(line, 10)));
     addstrch(s, "\n");
     addstrch(s, msg);
     return (Error) {(data) s, s->d.v->v};
@@ -71,29 +148,155 @@ Error makeErr(char* msg, Word line) {
 #define xfail(a, s) \
     if (a->f != s) { \
         fprintf(stderr, RED "\e[4mError: %s\n" RESET, fail(#a " is not " #s).msg); \
+        flushfiles(); \
         abort(); \
     }
 
 #define wordfail(a) xfail(a, words)
 #define funcfail(a) xfail(a, funcs)
-#define vectfail(a) xfail(a, vects)
+#define vectfail(a) do {asV(a); xfail(a, vects)} while (0)
 #define atomfail(a)  \
     if (!isA(a)) { \
         fprintf(stderr, RED "\e[4mError: %s\n" RESET, fail(#a " is not an atom or link").msg); \
+        flushfiles(); \
         abort(); \
     }
 
+// Live atoms of each form, all live atoms, their high-water mark, and
+// atoms made so far.  Forms only change through setform.
+Word formcounts[ends+1];
+Word atomslive = 0, atompeak = 0, atomsmade = 0;
+// countatom - void function
+void countatom(form f) {
+    formcounts[f]++;
+    atomsmade++;
+    if (++atomslive > atompeak) {atompeak = atomslive;}
+    if (!(atomsmade & 0xff)) {TRACE(TRALLOC, atomslive);}
+}
+// setform - void function
+void setform(Atom* a, form f) {
+    formcounts[a->f]--;
+    formcounts[f]++;
+    a->f = f;
+}
+// Frees the vect, channel, rope or slice a holds.
+// freedata - void function
+void freedata(Atom* a) {
+    if (a->f == vects) {freevect(a->d.v);}
+    if (a->f == ropes) {roperelease(a->d.p);}
+    if (a->f == slices) {slicerelease(a->d.s);}
+    chanrelease(asC(a));
+}
+// Atom slabs.
+// Atoms are cut ATOMSLAB at a time from slabs rather than malloced one
+// by one, so the atoms of a stack built a push at a time sit side by
+// side and walking it reads memory in order, as it would the cells of
+// an array.  Freed atoms are threaded through n onto a free list and
+// handed out again first, while they're still in cache; del frees a
+// list from its end, so rebuilding it takes the cells back in order.
+// Freed atoms are marked with the form FREEFORM, and once the free list
+// outgrows what's live, a sweep at a safe point frees the slabs whose
+// atoms are all free and rebuilds the list from the rest in address
+// order.  The rest are freed at exit, taking any atoms leaked with them;
+// the live count FJMEMSTATS prints still shows those.  Under AddressSanitizer,
+// or built with -DNOSLAB as `make val` does, every atom is malloced, so
+// the checkers see atoms used after they're freed and atoms leaked.
+#if defined(__SANITIZE_ADDRESS__) || defined(NOSLAB)
+#define MALLOCATOMS
+#endif
+#define ATOMSLAB 0x400
+#define FREEFORM (ends+1)
+typedef struct Slab Slab;
+struct Slab {
+    Slab* next;
+    Atom a[ATOMSLAB];
+};
+Slab* slabs;
+int slabused = ATOMSLAB; // Atoms handed out of the newest slab
+Atom* freeatoms;
+Word nfreeatoms = 0;
+Word slabkept = 0; // Free atoms the last sweep left in slabs it kept
+// allocatom - Atom* function
+Atom* allocatom() {
+#ifdef MALLOCATOMS
+    return malloc(sizeof(Atom));
+#else
+    Atom* a = freeatoms;
+    if (a) {freeatoms = a->n; nfreeatoms--; return a;}
+    if (slabused == ATOMSLAB) {
+        Slab* s = malloc(sizeof(Slab));
+        s->next = slabs;
+        slabs = s;
+        slabused = 0;
+    }
+    return &slabs->a[slabused++];
+#endif
+}
+// freeatom - void function
+void freeatom(Atom* a) {
+#ifdef MALLOCATOMS
+    reclaim(a, sizeof(Atom));
+#else
+    a->f = FREEFORM;
+    a->n = freeatoms;
+    freeatoms = a;
+    nfreeatoms++;
+#endif
+}
+// Frees the slabs with no atom in use, if enough atoms were freed since
+// the last sweep to pay for walking every slab.
+// slabsweep - void function
+void slabsweep() {
+#ifndef MALLOCATOMS
+    if (nfreeatoms < 2*ATOMSLAB || nfreeatoms < atomslive + 2*slabkept) {return;}
+    Slab* newest = slabs;
+    Atom* list = 0;
+    nfreeatoms = 0;
+    for (Slab** p = &slabs; *p; ) {
+        Slab* s = *p;
+        int cut = (s == newest) ? slabused : ATOMSLAB;
+        int nfree = 0;
+        for (int i = 0; i < cut; i++) {nfree += s->a[i].f == FREEFORM;}
+        if (nfree == cut) {
+            *p = s->next;
+            if (s == newest) {slabused = ATOMSLAB;}
+            reclaim(s, sizeof(Slab));
+            continue;
+        }
+        for (int i = cut - 1; i >= 0; i--) {
+            if (s->a[i].f == FREEFORM) {s->a[i].n = list; list = &s->a[i]; nfreeatoms++;}
+        }
+        p = &s->next;
+    }
+    freeatoms = list;
+    slabkept = nfreeatoms;
+#endif
+}
+// slabflush - void function
+void slabflush() {
+    while (slabs) {
+        Slab* s = slabs;
+        slabs = s->next;
+        reclaim(s, sizeof(Slab));
+    }
+    slabused = ATOMSLAB;
+    freeatoms = 0;
+    nfreeatoms = slabkept = 0;
+}
 // Creates a new, zero-initialized atom with no references.
 // new - Atom* function
 Atom* new(form f) {
-    Atom* a = malloc(sizeof(Atom));
-    *a = (Atom) {0, 0, f, 0, true};
+    Atom* a = allocatom();
+    *a = (Atom) {0, 0, f, true};
+    countatom(f);
     return a;
 }
 // newraw - Atom* function
 Atom* newraw(void* a) {
-    Atom* m = malloc(sizeof(Atom));
+    Atom* m = allocatom();
     cpymem((char*) m, a, sizeof(Atom));
+    m->m = 0; // marks describe the atom it was copied from
+    countatom(m->f);
     return m;
 }
 
@@ -120,35 +323,361 @@ Atom* traverselinks(Atom* d) {
     return traverselinks(asA(d));
 }
 
+// Cycle collector.
+// Reference counts can't free a cycle: a block that names itself, like
+// a recursive function, keeps its own count above zero.  Any container
+// whose count drops but stays above zero might be the last way into
+// one, so del buffers it as a possible root, and drops it from the
+// buffer again if it's freed after all.  At safe points collectcycles
+// trial-deletes the buffered roots: it subtracts the references held
+// inside their subgraphs, and whatever is left at zero is only
+// referenced by garbage.
+// Frozen atoms only point at frozen atoms and are held by the intern
+// table, so they're never part of a cycle and the walks skip them.
+#define MINROOTS 0x400
+// The buffer is an open-addressed set, kept at most half full.
+Atom** roots;
+int nroots = 0, maxroots = 0;
+// rootslot - int function
+int rootslot(Atom* a) {
+    return ((unsigned long long) (size_t) a >> 4) * 0x9E3779B97F4A7C15ull >> 32 & (maxroots-1);
+}
+// insertroot - void function
+void insertroot(Atom* a) {
+    int i = rootslot(a);
+    while (roots[i]) {i = (i+1) & (maxroots-1);}
+    roots[i] = a;
+    nroots++;
+}
+// possibleroot - void function
+void possibleroot(Atom* a) {
+    if (a->m & (BUFFERED | FROZEN)) {return;}
+    if (!isA(a)) {return;} // every cycle passes through a container
+    if (2*(nroots+1) > maxroots) {
+        Atom** old = roots;
+        int oldmax = maxroots;
+        maxroots = oldmax ? 2*oldmax : 2*MINROOTS;
+        roots = malloc(maxroots*sizeof(Atom*));
+        for (int i = 0; i < maxroots; i++) {roots[i] = 0;}
+        nroots = 0;
+        for (int i = 0; i < oldmax; i++) {if (old[i]) {insertroot(old[i]);}}
+        if (old) {reclaim(old, oldmax*sizeof(Atom*));}
+    }
+    insertroot(a);
+    a->m |= BUFFERED;
+}
+// Removes a from the buffer, shifting back the entries after it that
+// probed past its slot.
+// unbuffer - void function
+void unbuffer(Atom* a) {
+    int mask = maxroots-1;
+    int i = rootslot(a);
+    while (roots[i] != a) {i = (i+1) & mask;}
+    for (int j = (i+1) & mask; roots[j]; j = (j+1) & mask) {
+        int k = rootslot(roots[j]);
+        if ((j > i) ? (k <= i || k > j) : (k <= i && k > j)) {
+            roots[i] = roots[j];
+            i = j;
+        }
+    }
+    roots[i] = 0;
+    nroots--;
+    a->m &= ~BUFFERED;
+}
 // Deletes a reference to an atom.
-// If the atom reaches zero references, free its memory.
+// If the atom reaches zero references, free its memory, otherwise
+// buffer it for the cycle collector.
 // Also frees vects:
 //  - Vects don't have refcounts, so must be referenced by
 //    exactly one atom at all times.
+// A stack can be far longer than the C stack is deep, so the run of
+// atoms along n that reach zero is found first, threaded back through n,
+// and then freed from its far end, in the order recursing would have.
+// Only nesting recurses.
 // del - Atom* function
 Atom* del(Atom* a) {
     if (!a) {return 0;}
-    if (--a->r) {return a;}
-
-    freevect(asV(a));
-    if (!isend(a)) {del(a->n);}
-    if (del(asA(a))) {
-        // If a->d was referenced by something else,
-        // and a owns it, the parent points must be corrected.
-        Atom* n = tail(asA(a));
-        if (n->n == a) {n->n = 0;}
+    if (--a->r) {possibleroot(a); return a;}
+
+    Atom* back = 0;
+    while (true) {
+        if (a->m & BUFFERED) {unbuffer(a);}
+        freedata(a);
+        Atom* n = isend(a) ? 0 : a->n;
+        a->n = back;
+        back = a;
+        if (!n) {break;}
+        if (--n->r) {possibleroot(n); break;}
+        a = n;
+    }
+    while (back) {
+        a = back;
+        back = a->n;
+        if (del(asA(a))) {
+            // If a->d was referenced by something else,
+            // and a owns it, the parent points must be corrected.
+            Atom* n = tail(asA(a));
+            if (n->n == a) {n->n = 0;}
+        }
+        formcounts[a->f]--;
+        atomslive--;
+        freeatom(a);
     }
-    reclaim(a, sizeof(struct Atom));
     return 0;
 }
 // Get a reference to a.
 // Does nothing if a == 0.
 // ref - Atom* function
 Atom* ref(Atom* a) {if (a) {a->r++;} return a;}
+
+Atom** ccstack; // Walk stack shared by the phases
+int ccmaxlen = 0;
+Atom** rootlist; // The buffered roots being collected
+int rootmaxlen = 0;
+Word cyclesfreed = 0; // Atoms reclaimed by collectcycles
+
+// color - byte function
+byte color(Atom* a) {return a->m & COLOR;}
+// paint - void function
+void paint(Atom* a, byte c) {a->m = (a->m & ~COLOR) | c;}
+// Pushes the atoms a holds references to, adding dr to their counts.
+// cchildren - int function
+int cchildren(Atom* a, int top, int dr, byte skip) {
+    Atom* c[2] = {a->e ? 0 : a->n, asA(a)};
+    for (int i = 0; i < 2; i++) {
+        if (!c[i] || (c[i]->m & FROZEN)) {continue;}
+        c[i]->r += dr;
+        if (color(c[i]) == skip) {continue;}
+        ccstack = growarray(ccstack, &ccmaxlen, top+1, sizeof(Atom*));
+        ccstack[top++] = c[i];
+    }
+    return top;
+}
+// Subtract the references held inside a's subgraph, painting it gray.
+// markgray - void function
+void markgray(Atom* a) {
+    if (color(a) == GRAY) {return;}
+    paint(a, GRAY);
+    int top = cchildren(a, 0, -1, GRAY);
+    while (top) {
+        Atom* c = ccstack[--top];
+        if (color(c) == GRAY) {continue;}
+        paint(c, GRAY);
+        top = cchildren(c, top, -1, GRAY);
+    }
+}
+// Restore the references held inside a's subgraph, painting it black.
+// The walk uses the stack above base.
+// scanblack - void function
+void scanblack(Atom* a, int base) {
+    paint(a, 0);
+    int top = cchildren(a, base, 1, 0);
+    while (top > base) {
+        Atom* c = ccstack[--top];
+        if (!color(c)) {continue;}
+        paint(c, 0);
+        top = cchildren(c, top, 1, 0);
+    }
+}
+// Paint gray atoms still referenced from outside black, with everything
+// under them, and the rest white.
+// scanroot - void function
+void scanroot(Atom* a) {
+    int top = 0;
+    ccstack = growarray(ccstack, &ccmaxlen, 1, sizeof(Atom*));
+    ccstack[top++] = a;
+    while (top) {
+        Atom* c = ccstack[--top];
+        if (color(c) != GRAY) {continue;}
+        if (c->r > 0) {scanblack(c, top); continue;}
+        paint(c, WHITE);
+        top = cchildren(c, top, 0, WHITE);
+    }
+}
+// Releases what a doomed atom holds outside the doomed subgraph.  Its
+// other references were already subtracted, so that's only the frozen
+// atoms it points at.  If a survivor's parent pointer names it, that is
+// cleared, as del does.
+// releasedoomed - void function
+void releasedoomed(Atom* a) {
+    Atom* c[2] = {a->e ? 0 : a->n, asA(a)};
+    for (int i = 0; i < 2; i++) {
+        if (c[i] && (c[i]->m & FROZEN)) {del(c[i]);}
+    }
+    if (c[1] && color(c[1]) != DOOMED) {
+        Atom* t = tail(c[1]);
+        if (t->n == a) {t->n = 0;}
+    }
+}
+// Gathers the white atoms under a onto the stack from top, painting
+// them doomed.
+// collectwhite - int function
+int collectwhite(Atom* a, int top) {
+    if (color(a) != WHITE) {return top;}
+    int from = top;
+    paint(a, DOOMED);
+    ccstack = growarray(ccstack, &ccmaxlen, top+1, sizeof(Atom*));
+    ccstack[top++] = a;
+    for (int i = from; i < top; i++) {
+        Atom* c[2] = {ccstack[i]->e ? 0 : ccstack[i]->n, asA(ccstack[i])};
+        for (int j = 0; j < 2; j++) {
+            if (!c[j] || color(c[j]) != WHITE) {continue;}
+            paint(c[j], DOOMED);
+            ccstack = growarray(ccstack, &ccmaxlen, top+1, sizeof(Atom*));
+            ccstack[top++] = c[j];
+        }
+    }
+    return top;
+}
+// Reclaims every cycle reachable only from the buffered roots, and
+// returns how many atoms it freed.
+// collectcycles - Word function
+Word collectcycles() {
+    int n = 0;
+    rootlist = growarray(rootlist, &rootmaxlen, nroots, sizeof(Atom*));
+    for (int i = 0; i < maxroots; i++) {
+        if (!roots[i]) {continue;}
+        rootlist[n++] = roots[i];
+        roots[i]->m &= ~BUFFERED;
+        roots[i] = 0;
+    }
+    nroots = 0;
+    for (int i = 0; i < n; i++) {markgray(rootlist[i]);}
+    for (int i = 0; i < n; i++) {scanroot(rootlist[i]);}
+    int top = 0;
+    for (int i = 0; i < n; i++) {top = collectwhite(rootlist[i], top);}
+    for (int i = 0; i < top; i++) {releasedoomed(ccstack[i]);}
+    for (int i = 0; i < top; i++) {
+        Atom* a = ccstack[i];
+        freedata(a);
+        formcounts[a->f]--;
+        atomslive--;
+        freeatom(a);
+    }
+    cyclesfreed += top;
+    return top;
+}
+// Collects once enough roots are buffered, relative to the heap, that
+// the walks stay proportional to the work that buffered them.
+// safepoint - void function
+void safepoint() {
+    if (nroots >= MINROOTS && nroots >= atomslive / 8) {collectcycles();}
+    slabsweep();
+}
+// collectfree - void function
+void collectfree() {
+    collectcycles();
+    reclaim(roots, maxroots*sizeof(Atom*));
+    reclaim(rootlist, rootmaxlen*sizeof(Atom*));
+    reclaim(ccstack, ccmaxlen*sizeof(Atom*));
+    roots = rootlist = ccstack = 0;
+    maxroots = rootmaxlen = ccmaxlen = 0;
+}
+
+// Bumped by any change that can alter what a scan finds in a list it
+// already walked: a link between existing atoms is replaced, or the
+// contents of a `:` scope change.  Checked by the inline caches.
+Word scopever = 0;
+// Bumped by any change to an atom marked HASHED, retiring every cached
+// shape hash at once.  Retiring only the hashes covering the atom would
+// mean walking from it to the end of its list and on up through the
+// lists holding that, on every change; this keeps a change O(1), and a
+// program that changes hashed lists while it compares others pays a
+// rehash of what it compares next instead.
+Word shapever = 1;
+// True if a is a `:` scope, that scan descends into.
+// isscope - bool function
+bool isscope(Atom* a) {
+    if (a->e || !asV(a->n)) {return false;}
+    char* c = asV(a->n)->v;
+    return c[0] == ':' && !c[1];
+}
+
+// Undo journal.
+// While a checkpoint is open, each referenced atom is snapshotted
+// before it is changed, into a fixed ring of entries.  The snapshot
+// holds references to the old n and t, so rollback only has to copy the
+// entries back, newest first.  Nothing is allocated per change.
+// When the ring is full the oldest entry is dropped, which makes any
+// checkpoint older than it impossible to roll back to.
+#define JOURNALLEN 0x1000
+#define CHECKPOINTS 0x40
+typedef struct Entry Entry;
+struct Entry {Atom* a; Atom snap;};
+Entry journal[JOURNALLEN];
+Word jbase = 0, jtop = 0; // Sequence numbers of the oldest and next entry
+Word checkpoints[CHECKPOINTS];
+int ncheckpoints = 0;
+
+// releaseentry - void function
+void releaseentry(Entry* en) {
+    if (!en->snap.e) {del(en->snap.n);}
+    if (isA(&en->snap)) {del(en->snap.d.a);}
+    del(en->a);
+}
+// Snapshot a before it is changed.
+// Atoms without references are fresh and cannot be seen after a rollback.
+// journalatom - void function
+void journalatom(Atom* a) {
+    if (a->m & FROZEN) {
+        fprintf(stderr, RED "\e[4mError: %s\n" RESET, fail("a frozen atom was changed").msg);
+        flushfiles();
+        abort();
+    }
+    if (a->m & HASHED) {shapever++;}
+    if (!ncheckpoints || !a->r) {return;}
+    if (jtop - jbase == JOURNALLEN) {releaseentry(&journal[jbase++ % JOURNALLEN]);}
+    Entry* en = &journal[jtop++ % JOURNALLEN];
+    en->a = ref(a);
+    en->snap = *a;
+    if (!a->e) {ref(a->n);}
+    if (isA(a)) {ref(a->d.a);}
+}
+// Turns a rope or slice into a vect of its own holding its bytes.  It's
+// the same string, so nothing is journaled, but shape hashes covering it
+// go stale.
+// flatten - void function
+void flatten(Atom* a) {
+    int len = (a->f == ropes) ? a->d.p->len : a->d.s->len;
+    Vect* v = valloclen(len + 1);
+    if (a->f == ropes) {ropecopy(a->d.p, v->v); roperelease(a->d.p);}
+    else {cpymem(v->v, a->d.s->s->v->v + a->d.s->off, len); slicerelease(a->d.s);}
+    v->v[len] = 0;
+    v->len = len + 1;
+    a->d.v = v;
+    setform(a, vects);
+    if (a->m & HASHED) {shapever++;}
+}
+// Restore every atom changed since sequence number c.
+// journalrollback - void function
+void journalrollback(Word c) {
+    scopever++;
+    shapever++;
+    while (jtop > c) {
+        Entry* en = &journal[--jtop % JOURNALLEN];
+        Atom* a = en->a;
+        Atom cur = *a;
+        bool sett = isA(&en->snap) && isA(a);
+        a->n = en->snap.n;
+        a->e = en->snap.e;
+        if (sett) {a->d = en->snap.d; setform(a, en->snap.f);}
+        else if (isA(&en->snap)) {del(en->snap.d.a);}
+        if (!cur.e) {del(cur.n);}
+        if (sett) {del(cur.d.a);}
+        del(a);
+    }
+}
+// Drop every entry, keeping the changes they recorded.
+// journalrelease - void function
+void journalrelease() {
+    while (jbase < jtop) {releaseentry(&journal[jbase++ % JOURNALLEN]);}
+}
 // Set a's n value.  Adjust references accordingly.
 // Adjusts the 'end' flag if needed.
 // nset - Atom* function
 Atom* nset(Atom* a, Atom* n) {
+    journalatom(a);
+    if (!a->e && a->n) {scopever++;}
     ref(n);
     if (!a->e) {del(a->n);}
     a->e = !n;
@@ -158,19 +687,25 @@ Atom* nset(Atom* a, Atom* n) {
 // Set a's t value.  Adjust references accordingly.
 // tset - Atom* function
 Atom* tset(Atom* a, Atom* t) {
+    journalatom(a);
+    if (isscope(a)) {scopever++;}
     ref(t);
     del(asA(a));
     a->d.a = t;
     return a;
 }
 
+Atom* duplicate(Atom* a);
 // Points d->d to a and appends a to the old d->d
 // ends type is used only in tandem with pull: it signifies the
 // empty list, while still holding a parent pointer.
 // push - Atom* function
 Atom* push(Atom* d, Atom* a) {
+    tracepushes++;
+    if (isfrozen(a)) {a = duplicate(a);} // frozen atoms can't be relinked
     if (isempty(d)) {
-        if (!a->e) {del(a->n);}
+        journalatom(a);
+        if (!a->e) {del(a->n); scopever++;}
         a->n = (asA(d)) ? asA(d)->n : d;
         a->e = true;
     }
@@ -199,6 +734,7 @@ Atom* pushend(Atom* d, Atom* t) {
 void pull(Atom* d) {
     atomfail(d);
     if (isempty(d)) {return;}
+    tracepulls++;
     if (isend(asA(d))) {pushend(d, asA(d)->n);}
     else {tset(d, asA(d)->n);}
     return;
@@ -253,12 +789,35 @@ Word pullw(Atom* d) {
     pull(d);
     return w;
 }
+// Words on d are changed in place where they can be, instead of pulled
+// and pushed again as new atoms, so `1 +.` in a loop touches one atom.
+// a must be a word that only one atom or stack holds, and not frozen.
+// A rollback doesn't restore a word's value, so nothing is changed in
+// place while a checkpoint is open.
+// owned - Atom* function
+Atom* owned(Atom* a) {
+    if (!a || a->f != words || a->r != 1 || (a->m & FROZEN) || ncheckpoints) {return 0;}
+    return a;
+}
+// Counts as pulling a and pushing w.
+// setword - void function
+void setword(Atom* a, Word w) {
+    tracepulls++;
+    tracepushes++;
+    journalatom(a); // Only to mark shape hashes stale, with no checkpoint
+    a->d.w = w;
+}
 
 // Swap the top two elements.
 // swap - Error function
 Error swap(Atom* d) {
     if (isend(asA(d))) {return fail("Not two elements to swap.");}
     Atom* b = asA(d)->n;
+    if (isfrozen(asA(d)) || isfrozen(b)) {return fail("stack is frozen");}
+    journalatom(d);
+    journalatom(asA(d));
+    journalatom(b);
+    scopever++;
     asA(d)->n = asA(d)->n->n;
     b->n = asA(d);
     d->d.a = b;
@@ -272,7 +831,10 @@ Error swap(Atom* d) {
 // duplicate - Atom* function
 Atom* duplicate(Atom* a) {
     data d = a->d;
-    if(asV(a)) {d = (data) dupvect(asV(a));}
+    if (a->f == ropes) {roperef(d.p);}
+    else if (a->f == slices) {d.s = newslice(d.s->s, d.s->off, d.s->len);}
+    else if(asV(a)) {d = (data) dupvect(asV(a));}
+    if(asC(a)) {d = (data) chanref(asC(a));}
     if(asA(a)) {d = (data) ref(asA(a));}
     Atom* b = new(a->f);
     b->d = d;
@@ -294,11 +856,27 @@ int length(Atom* a) {
     while (!a->e) {a = a->n; i++;}
     return i;
 }
+// A stack's elements bottom first, so it can be walked in program
+// order.  The view holds no references; the stack must outlive it.
+typedef struct Revview Revview;
+struct Revview {Atom** a; int len;};
+// Views a alone, or a and everything under it when all is set.
+// revview - Revview function
+Revview revview(Atom* a, bool all) {
+    int len = 1;
+    if (all) {for (Atom* c = a; !isend(c); c = c->n) {len++;}}
+    Revview v = {malloc(len*sizeof(Atom*)), len};
+    for (int i = len - 1; i >= 0; i--) {v.a[i] = a; a = a->n;}
+    return v;
+}
+// freerevview - void function
+void freerevview(Revview* v) {reclaim(v->a, v->len*sizeof(Atom*));}
 // pullx - Error function
 Error pullx(Atom* d, int i) {
     atomfail(d);
     if (length(d) < i) {return fail("tried to remove too many elements from d");}
     Atom* a = asA(d);
+    tracepulls++;
     while (a && !a->e && i) {a = a->n; i--;}
     if (i) {pushend(d, a->n);}
     else {tset(d, a);}
@@ -309,6 +887,9 @@ Error pullx(Atom* d, int i) {
 // removeafter - Error function
 Error removeafter(Atom* a) {
     if (a->e) {return fail("No element after a to remove.");}
+    if (isfrozen(a)) {return fail("stack is frozen");}
+    journalatom(a);
+    scopever++;
     bool e = a->n->e;
     if (!e) {nset(a, a->n->n);}
     else {
@@ -339,7 +920,6 @@ int chlen(char* c) {
 Atom* newvect(int len) {
     int maxlen = (len > 0) ? len : 1;
     Atom* a = new(vects);
-    a->f = vects;
     a->d.v = valloclen(maxlen);
     return a;
 }
@@ -357,6 +937,13 @@ bool equstr(char* a, char* b) {
     if (*a || *b) {return false;}
     return true;
 }
+// Returns true if the vects hold the same bytes
+// equvect - bool function
+bool equvect(Vect* a, Vect* b) {
+    if (a->len != b->len) {return false;}
+    for (int i = 0; i < a->len; i++) {if (a->v[i] != b->v[i]) {return false;}}
+    return true;
+}
 
 // Changes the string object to the new string
 // setstr - Atom* function
@@ -370,17 +957,60 @@ Atom* setstr(Atom* s, char* c, int len) {
 Atom* newstrlen(char* c, int len) {return setstr(newvect(len), c, len);}
 // str - Atom* function
 Atom* str(char* c) {return newstrlen(c, chlen(c));}
+// Marks the builtin s names as shadowed, for strings handed to the program.
+// shadow - Atom* function
+Atom* shadow(Atom* s) {
+    int i = builtinindex(asV(s)->v);
+    if (i >= 0) {shadowed[i] = true;}
+    return s;
+}
 // dupstr - Atom* function
 Atom* dupstr(Atom* s) {return str(asV(s)->v);}
+
+// The bytes of a string, read in place whether it's a vect or a slice.
+typedef struct Span Span;
+struct Span {byte* v; int len;};
+// span - Span function
+Span span(Atom* s) {
+    if (s && s->f == slices) {return (Span) {s->d.s->s->v->v + s->d.s->off, s->d.s->len};}
+    Vect* v = asV(s);
+    if (!v) {return (Span) {0, 0};}
+    int n = v->len;
+    if (n && !v->v[n-1]) {n--;}
+    return (Span) {v->v, n};
+}
+// isstr - bool function
+bool isstr(Atom* s) {return s && (s->f == vects || s->f == slices || s->f == ropes);}
+// equspan - bool function
+bool equspan(Span a, Span b) {
+    if (a.len != b.len) {return false;}
+    for (int i = 0; i < a.len; i++) {if (a.v[i] != b.v[i]) {return false;}}
+    return true;
+}
+// Turns s into a slice of all of itself, handing its vect over to be
+// shared, and returns the slice.  A frozen string keeps its vect, so
+// the slices get a copy of it.
+// sliceof - Slice* function
+Slice* sliceof(Atom* s) {
+    if (s->f == slices) {return s->d.s;}
+    Span v = span(s);
+    Shared* h = newshared((s->m & FROZEN) ? dupvect(s->d.v) : s->d.v);
+    Slice* c = newslice(h, v.v - s->d.v->v, v.len);
+    if (s->m & FROZEN) {return c;}
+    s->d.s = c;
+    setform(s, slices);
+    if (s->m & HASHED) {shapever++;}
+    return c;
+}
+// New slice of s from byte a up to b, or to the end if b is -1.
 // substr - Atom* function
 Atom* substr(Atom* s, int a, int b) {
-    Vect* v = s->d.v;
-    if (b == -1) {
-        if (!a) {return dupstr(s);}
-        b = v->len;
-    }
-    if (a == b) {return newvect(0);}
-    return newstrlen(v->v+a, b-a);
+    Slice* c = sliceof(s);
+    if (b == -1) {b = c->len;}
+    Atom* t = new(slices);
+    t->d.s = newslice(c->s, c->off + a, b - a);
+    if (s->f != slices) {slicerelease(c);}
+    return t;
 }
 // printstr - Atom* function
 Atom* printstr(Atom* s) {
@@ -406,29 +1036,79 @@ Atom* addstrch(Atom* s, char* ch) {
     s->d.v = rawpushv(asV(s), ch, chlen(ch)+1);
     return s;
 }
+// addspan - Atom* function
+Atom* addspan(Atom* s, Span v) {
+    if (asV(s)->len) {asV(s)->len--;} // remove the null char at the end
+    s->d.v = rawpushv(asV(s), v.v, v.len);
+    s->d.v = vectpushc(s->d.v, '\0');
+    return s;
+}
 #define WORDCOLOR DARKCYAN
 #define VECTCOLOR DARKGREEN
 #define FUNCCOLOR GREEN
 #define ATOMCOLOR YELLOW
 #define DOTSCOLOR DARKRED
+// Base used when printing words.  Set with the `base` builtin.
+int numbase = 0x10;
+// Digit pairs for 00..99 and 00..ff, so numbers are
+// formatted two digits per division.
+const char decpairs[] =
+    "0001020304050607080910111213141516171819"
+    "2021222324252627282930313233343536373839"
+    "4041424344454647484950515253545556575859"
+    "6061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+const char hexpairs[] =
+    "000102030405060708090a0b0c0d0e0f101112131415161718191a1b1c1d1e1f"
+    "202122232425262728292a2b2c2d2e2f303132333435363738393a3b3c3d3e3f"
+    "404142434445464748494a4b4c4d4e4f505152535455565758595a5b5c5d5e5f"
+    "606162636465666768696a6b6c6d6e6f707172737475767778797a7b7c7d7e7f"
+    "808182838485868788898a8b8c8d8e8f909192939495969798999a9b9c9d9e9f"
+    "a0a1a2a3a4a5a6a7a8a9aaabacadaeafb0b1b2b3b4b5b6b7b8b9babbbcbdbebf"
+    "c0c1c2c3c4c5c6c7c8c9cacbcccdcecfd0d1d2d3d4d5d6d7d8d9dadbdcdddedf"
+    "e0e1e2e3e4e5e6e7e8e9eaebecedeeeff0f1f2f3f4f5f6f7f8f9fafbfcfdfeff";
+// Longest formatted word: 64 binary digits, a sign and the null char.
+#define NUMBUFLEN 66
+// Formats n in base b backward from the end of buf, without allocating.
+// buf must hold NUMBUFLEN bytes.  Returns the start of the null
+// terminated digits inside buf.
+// fmtword - char* function
+char* fmtword(char* buf, Word n, int b) {
+    char* c = buf+NUMBUFLEN-1;
+    *c = 0;
+    unsigned long long u = (n < 0) ? -(unsigned long long) n : n;
+    if (b == 10) {
+        while (u >= 100) {
+            c -= 2;
+            cpymem(c, (char*) decpairs+2*(u % 100), 2);
+            u /= 100;
+        }
+        if (u >= 10) {c -= 2; cpymem(c, (char*) decpairs+2*u, 2);}
+        else {*--c = '0'+u;}
+    }
+    else if (b == 0x10) {
+        while (u >= 0x100) {
+            c -= 2;
+            cpymem(c, (char*) hexpairs+2*(u & 0xff), 2);
+            u >>= 8;
+        }
+        if (u >= 0x10) {c -= 2; cpymem(c, (char*) hexpairs+2*u, 2);}
+        else {*--c = hexpairs[2*u+1];}
+    }
+    else {
+        do {
+            int m = u % b;
+            *--c = (m < 10) ? '0'+m : 'a'+m-10;
+            u /= b;
+        } while (u);
+    }
+    if (n < 0) {*--c = '-';}
+    return c;
+}
 // inttostr - Atom* function
-Atom* inttostr(int n, int b) {
-    bool neg = n < 0;
-    if (neg) {n = -n;}
-
-    if (n == 0) {return str("0");}
-    Atom* s = newvect(0);
-    char c;
-    while (n > 0) {
-        if (n % b >= 10) {c = 'a' + (n % b) - 10;}
-        else {c = '0' + (n % b);}
-        s->d.v = vectpushc(asV(s), c);
-        n /= b;
-    }
-    if (neg) {s->d.v = vectpushc(asV(s), '-');}
-    reversevect(asV(s));
-    s->d.v = vectpushc(asV(s), 0);
-    return s;
+Atom* inttostr(Word n, int b) {
+    char buf[NUMBUFLEN];
+    return str(fmtword(buf, n, b));
 }
 
 Error scanfunc(Atom* D, Atom* d, Atom* e, Atom* r);
@@ -436,9 +1116,80 @@ Atom* reversescan(Atom* a, Atom* w);
 
 Atom* scan(Atom* a, Atom* end, char* c);
 Atom* scantail(Atom* a, char* c);
+Atom* lookup(Atom* a, char* c);
 Error dot(Atom* D, Atom* d, Atom* e, Atom* r);
 bool debugging = false;
 // atomstr - Atom* function
+Atom* atomstr(Atom* a, int indent, char* spinecolor, bool next);
+// String for a single element of a stack.
+// elemstr - Atom* function
+Atom* elemstr(Atom* cur, int indent, char* spinecolor) {
+    Atom* s2 = 0;
+    if (cur->f == ropes) {asV(cur);}
+    if (isA(cur)) {
+        if (isempty(cur)) {
+            char* c = "\033[4;1;33m@" RESET;
+            if (cur->f == execs) {c = "\033[4;1;32m@" RESET;}
+            if (cur->f == links) {c = "\033[4;1;33m~" RESET;}
+            s2 = str(c);
+        }
+        else {
+            Atom* v = (debugging) ? 0 : scantail(asA(cur), "\"");
+            if (v) {
+                Atom* d = ref(new(links));
+                tset(d, cur);
+                push(d, duplicate(v));
+                dot(d, d, 0, 0);
+                s2 = str(RESET);
+                Error er = pulln(d);
+                if (er.msg) {del(ref(s2)); del(d); return 0;}
+                addstr(s2, er.d.a);
+                del(d);
+            }
+            else {
+                char* c;
+                if (cur->f == atoms) {c = ATOMCOLOR "@ " RESET;}
+                if (cur->f == execs) {c = FUNCCOLOR "@ " RESET;}
+                if (cur->f == links) {c = ATOMCOLOR "~ " RESET;}
+                s2 = str(c);
+                addstr(s2, ref(atomstr(asA(cur), indent + 1, spinecolor, true)));
+            }
+        }
+    }
+    else if (cur->f == dots) {s2 = str(DOTSCOLOR ".");}
+    else if (cur->f == chans) {
+        char buf[NUMBUFLEN];
+        s2 = str(FUNCCOLOR "chan ");
+        addstrch(s2, fmtword(buf, chanlen(cur->d.c), numbase));
+    }
+    else if (cur->f == vects || cur->f == slices) {
+        s2 = str(VECTCOLOR);
+        addspan(s2, span(cur));
+    }
+    else if (cur->f == words) {
+        char buf[NUMBUFLEN];
+        s2 = str(WORDCOLOR);
+        addstrch(s2, fmtword(buf, cur->d.w, numbase));
+    }
+    else if (cur->f == funcs) {
+        s2 = str(FUNCCOLOR);
+        Atom* name = reversescan(cur->n, cur);
+        if (!name && builtinname(cur->d.f)) {name = str((char*) builtinname(cur->d.f));}
+        addstr(s2, ref(name));
+    }
+    return s2;
+}
+// Appends the strings of view elements from..to, bottom first.
+// addrunstr - bool function
+bool addrunstr(Atom* s1, Revview* v, int from, int to, int indent, char* spinecolor) {
+    for (int i = from; i < to; i++) {
+        Atom* s2 = elemstr(v->a[i], indent, spinecolor);
+        if (!s2) {return false;}
+        addstr(s1, ref(s2));
+        addstrch(s1, " ");
+    }
+    return true;
+}
 Atom* atomstr(Atom* a, int indent, char* spinecolor, bool next) {
     if (!a) {return str(RED "None");}
     Atom* cur = a;
@@ -448,74 +1199,27 @@ Atom* atomstr(Atom* a, int indent, char* spinecolor, bool next) {
         cur = cur->n;
     }
     if (!arenewlines) {arenewlines = !isempty(cur);}
-    cur = a;
     Atom* s1 = newvect(0);
-    Atom* lines = ref(new(atoms));
+    // Runs of elements between blocks print bottom first, so walk the
+    // view top down and emit each finished run from its bottom.
+    Revview v = revview(a, next);
+    int run = v.len;
     bool newlines = false;
-    while (cur) {
+    for (int i = v.len - 1; i >= 0; i--) {
+        cur = v.a[i];
         if (newlines || (asA(cur) && cur != a)) {
             addstrch(s1, "\n");
-            for (int i = 0; i < indent-1; i++) {addstrch(s1, " ");}
+            for (int k = 0; k < indent-1; k++) {addstrch(s1, " ");}
             if (indent) {addstrch(s1, spinecolor); addstrch(s1, "├");}
-            while (!isempty(lines)) {
-                addstr(s1, ref(asA(lines)));
-                addstrch(s1, " ");
-                pull(lines);
-            }
+            if (!addrunstr(s1, &v, i + 1, run, indent, spinecolor)) {run = -1; break;}
+            run = i + 1;
             newlines = false;
         }
-        Atom* s2 = 0;
-        if (isA(cur)) {
-            if (isempty(cur)) {
-                char* c = "\033[4;1;33m@" RESET;
-                if (cur->f == execs) {c = "\033[4;1;32m@" RESET;}
-                if (cur->f == links) {c = "\033[4;1;33m~" RESET;}
-                s2 = str(c);
-            }
-            else {
-                Atom* v = (debugging) ? 0 : scantail(asA(cur), "\"");
-                if (v) {
-                    Atom* d = ref(new(links));
-                    tset(d, cur);
-                    push(d, duplicate(v));
-                    dot(d, d, 0, 0);
-                    s2 = str(RESET);
-                    Error er = pulln(d);
-                    if (er.msg) {return 0;}
-                    addstr(s2, er.d.a);
-                    del(d);
-                }
-                else {
-                    char* c;
-                    if (cur->f == atoms) {c = ATOMCOLOR "@ " RESET;}
-                    if (cur->f == execs) {c = FUNCCOLOR "@ " RESET;}
-                    if (cur->f == links) {c = ATOMCOLOR "~ " RESET;}
-                    s2 = str(c);
-                    addstr(s2, ref(atomstr(asA(cur), indent + 1, spinecolor, true)));
-                }
-                arenewlines = true;
-                newlines = true;
-            }
-        }
-        else if (cur->f == dots) {s2 = str(DOTSCOLOR ".");}
-        else if (cur->f == vects) {
-            s2 = str(VECTCOLOR);
-            addstrch(s2, cur->d.v->v);
-        }
-        else if (cur->f == words) {
-            s2 = str(WORDCOLOR);
-            addstr(s2, ref(inttostr(cur->d.w, 0x10)));
-        }
-        else if (cur->f == funcs) {
-            s2 = str(FUNCCOLOR);
-            addstr(s2, ref(reversescan(cur->n, cur)));
+        if (isA(cur) && !isempty(cur)) {
+            arenewlines = true;
+            newlines = true;
         }
-
-        if (s2) {push(lines, s2);}
-        else {return str(RED "None");}
         addstrch(s1, RESET);
-        if (isend(cur) || !next) {break;}
-        cur = cur->n;
     }
     if (arenewlines) {
         addstrch(s1, "\n");
@@ -525,12 +1229,12 @@ Atom* atomstr(Atom* a, int indent, char* spinecolor, bool next) {
             else {addstrch(s1, spinecolor); addstrch(s1, "├");}
         }
     }
-    while (!isempty(lines)) {
-        addstr(s1, ref(asA(lines)));
-        addstrch(s1, " ");
-        pull(lines);
+    if (run < 0 || !addrunstr(s1, &v, 0, run, indent, spinecolor)) {
+        freerevview(&v);
+        del(ref(s1));
+        return str(RED "None");
     }
-    del(lines);
+    freerevview(&v);
     return s1;
 }
 
@@ -538,49 +1242,50 @@ Atom* atomstr(Atom* a, int indent, char* spinecolor, bool next) {
 void printa(Atom* a) {
     Atom* s = atomstr(a, 0, (a == Threads) ? RED : YELLOW, false);
     printstr(s);
-    freevect(asV(s));
-    reclaim(s, sizeof(struct Atom));
+    del(ref(s));
     puts("\n");
 }
 // println - void function
 void println(Atom* a) {
     Atom* s = atomstr(a, 0, (a == Threads) ? RED : YELLOW, true);
     printstr(s);
-    freevect(asV(s));
-    reclaim(s, sizeof(struct Atom));
+    del(ref(s));
     puts("\n");
 }
 
 // get the index in the string vect where a member of c first appears
 // strindexof - int function
 int strindexof(Atom* s, char* c) {
-    if (!asV(s)) {return -1;}
-    Vect* v = asV(s);
+    Span v = span(s);
     int i = 0;
-    while (i < v->len && !contains(c, v->v[i])) {i++;}
-    if (i == v->len) {return -1;}
+    while (i < v.len && !contains(c, v.v[i])) {i++;}
+    if (i == v.len) {return -1;}
     return i;
 }
 // strindexofnot - int function
 int strindexofnot(Atom* s, char* c) {
-    if (!asV(s)) {return -1;}
-    Vect* v = asV(s);
+    Span v = span(s);
     int i = 0;
-    while (i < v->len && contains(c, v->v[i])) {i++;}
-    if (i == v->len) {return -1;}
+    while (i < v.len && contains(c, v.v[i])) {i++;}
+    if (i == v.len) {return -1;}
     return i;
 }
 // isstrempty - bool function
-bool isstrempty(Atom* s) {return asV(s)->len == 0 || asV(s)->v[0] == 0;}
+bool isstrempty(Atom* s) {Span v = span(s); return !v.len || !v.v[0];}
+// Drops the first n bytes of s, or all of them if n is -1, by moving
+// the start of its slice.
 // discardn - bool function
 bool discardn(Atom* s, int n) {
-    setstr(s, s->d.v->v+n, s->d.v->len-n);
+    Slice* c = sliceof(s);
+    if (n == -1 || n > c->len) {n = c->len;}
+    c->off += n;
+    c->len -= n;
     return isstrempty(s);
 }
 // shrinks s1 to length i and returns s2 as the part that was removed
 // splitat - Atom* function
 Atom* splitat(Atom* s1, int i) {
-    if (i == -1) {i = s1->d.v->len;}
+    if (i == -1) {i = span(s1).len;}
     Atom* s2 = substr(s1, 0, i);
     discardn(s1, i);
     return s2;
@@ -598,33 +1303,33 @@ Atom* splitonnotchars(Atom* s, char* c) {
 
 // isnum - bool function
 bool isnum(char c) {return c >= '0' && c <= '9';}
-// ishex - bool function
-bool ishex(char c) {return isnum(c) || (c >= 'a' && c <= 'f');}
+// Value+1 of each digit character.  0 marks a non-digit, so one
+// unsigned compare against the base rejects both.
+const byte digitvals[0x80] = {
+    ['0'] = 1, 2, 3, 4, 5, 6, 7, 8, 9, 10,
+    ['a'] = 11, 12, 13, 14, 15, 16,
+};
 
 // strtonum - Atom* function
 Atom* strtonum(Atom* s) {
     char* str = asV(s)->v;
     if (!str) return 0;
-    bool negative = false;
-    if (*str == '-') {negative = true; str++;}
+    bool negative = *str == '-';
+    str += negative;
     if (!isnum(*str)) {return 0;}
 
-    int b = 10;
+    unsigned int b = 10;
     if (str[0] == '0') {
         if (str[1] == 'x')      {b = 0x10; str += 2;}
         else if (str[1] == 'b') {b = 0b10; str += 2;}
-        else if (!isnum(*str)) {return 0;}
     }
 
-    Word result = 0;
-    while (*str) {
-        if (*str == '_') { str++; continue; }
-        int digit;
-        if      (isnum(*str)) {digit = *str - '0';}
-        else if (ishex(*str)) {digit = *str - 'a' + 10;}
-        if (digit < 0 || digit > b) {return 0;}
+    unsigned long long result = 0;
+    for (unsigned char c; (c = *str); str++) {
+        if (c == '_') {continue;}
+        unsigned int digit = (c < 0x80) ? digitvals[c]-1 : b;
+        if (digit >= b) {return 0;}
         result = result*b + digit;
-        str++;
     }
     Atom* w = new(words);
     w->d.w = negative ? -result : result;
@@ -643,17 +1348,18 @@ bool discardwhitespace(Atom* s) {
 // charptostr - Atom* function
 Atom* charptostr(Atom* a, char addon, char breakon) {
     int i, j, depth = 1;
-    char* c = asV(a)->v;
+    Span in = span(a);
+    char* c = in.v;
     Atom* s = newvect(0);
     Vect* v = asV(s);
     char ch;
     i = 0; j = 1;
-    for (; c[i+j]; i++) {
+    for (; i+j < in.len; i++) {
         if (c[i+j] == breakon) {depth--;}
         if (!depth) {break;}
         if (c[i+j] == addon) {depth++;}
         ch = c[i+j];
-        if (c[i+j] == '\\') {
+        if (c[i+j] == '\\' && i+j+1 < in.len) {
             j++;
             ch = c[i+j];
             if (c[i+j] == 'n') {ch = '\n';}
@@ -718,29 +1424,73 @@ Atom* scan(Atom* a, Atom* end, char* c) {
 Atom* scantail(Atom* a, char* c) {
     return scan(a, (Atom*) -1, c);
 }
-// varrecscanfunc - Error function
-Error varrecscanfunc(Atom* D, Atom* d, Atom* e, Atom* r) {
-    Error er = pulln(d);
-    if (er.msg) {return er;}
-    Atom* s = er.d.a;
-    vectfail(s);
-    if (asV(asA(d))) {
-        er = varrecscanfunc(D, d, e, r);
-        if (er.msg) {return er;}
-    }    
-    Atom* paa = asA(asA(d));
-    Atom* a = scantail(paa, asV(s)->v);
-    if (a) {
+// Inline caches for names resolved inside blocks.
+// The call site is the block element that pushed the name.  A hit
+// needs the same site, the same stack being searched, and no change
+// to scopes since the lookup (see scopever).  Entries hold references,
+// so none of their atoms can be freed and reused while cached.
+typedef struct Icache Icache;
+struct Icache {Atom* site; Atom* scope; Word ver; Atom* hit;};
+#define ICACHELEN 0x100
+Icache icaches[ICACHELEN];
+
+// icachescan - Atom* function
+Atom* icachescan(Atom* site, Atom* scope, char* c) {
+    if (!site || !scope) {return scantail(scope, c);}
+    Icache* ic = &icaches[((Word) site >> 4) & (ICACHELEN-1)];
+    if (ic->site == site && ic->scope == scope && ic->ver == scopever) {
+        return ic->hit;
+    }
+    Atom* a = scantail(scope, c);
+    if (!a) {return 0;}
+    del(ic->site); del(ic->scope); del(ic->hit);
+    *ic = (Icache) {ref(site), ref(scope), scopever, ref(a)};
+    return a;
+}
+// icacheflush - void function
+void icacheflush() {
+    for (int i = 0; i < ICACHELEN; i++) {
+        Icache* ic = &icaches[i];
+        del(ic->site); del(ic->scope); del(ic->hit);
+        *ic = (Icache) {0};
+    }
+}
+
+// Resolves a chain of names `:a :b :c.` on top of d.
+// The deepest name is looked up in the stack under the names,
+// then each following name is looked up in the previous result.
+// When run from a block, `site` is the dots element doing the lookup.
+// Names pushed by the elements right before it have those elements
+// as call sites.
+// varrecscan - Error function
+Error varrecscan(Atom* D, Atom* d, Atom* site) {
+    // Pairs of name and call site.  Names are kept by reference rather
+    // than relinked, so lists sharing them are left alone.
+    Atom* names = ref(new(atoms));
+    while (asV(asA(d))) {
+        pushnew(names, words, pulln(d).d);
+        if (site) {site = (!isend(site) && asV(site->n)) ? site->n : 0;}
+        pushnew(names, words, (data) site);
+    }
+    Error er = passA(d);
+    while (!isempty(names)) {
+        Atom* site = asA(names)->d.a;
+        pull(names);
+        Atom* s = asA(names)->d.a;
+        pull(names);
+        Atom* a = (er.msg) ? 0 : icachescan(site, asA(asA(d)), asV(s)->v);
+        del(s);
+        if (!a) {
+            if (!er.msg) {er = fail("Could not find variable in scan");}
+            continue;
+        }
         ref(a);
         pull(d);
         push(d, duplicate(a));
         del(a);
     }
-    else {
-        return fail("Could not find variable in scan");
-    }
-    del(s);
-    return passA(d);
+    del(names);
+    return er;
 }
 // scanfunc - Error function
 Error scanfunc(Atom* D, Atom* d, Atom* e, Atom* r) {
@@ -749,7 +1499,7 @@ Error scanfunc(Atom* D, Atom* d, Atom* e, Atom* r) {
     Atom* s = er.d.a;
     vectfail(s);
     Atom* pa = asA(d);
-    Atom* a = scan(pa, 0, asV(s)->v);
+    Atom* a = lookup(pa, asV(s)->v);
     if (a) {push(d, duplicate(a));}
     del(s);
     return passA(d);
@@ -757,65 +1507,475 @@ Error scanfunc(Atom* D, Atom* d, Atom* e, Atom* r) {
 
 // growthreadexec - void function
 void growthreadexec(Atom* e, Atom* a) {
-    e->f = execs;
+    journalatom(e);
+    setform(e, execs);
     pushnew(e, atoms, (data) a);
-    if (!isend(a)) {return growthreadexec(e, a->n);}
+    while (!isend(a)) {
+        a = a->n;
+        pushnew(e, atoms, (data) a);
+    }
+}
+// Parked threads.
+// A read or channel operation that would block while a thread is being
+// stepped parks the thread instead: the builtin puts back what it took
+// and records what it waits for in parking, run puts the instruction
+// back, and advancethreads skips the thread until that's ready.  The
+// main program runs the threads while it waits.
+typedef struct Park Park;
+struct Park {
+    Atom* t;
+    int fd;    // Waits for fd to be readable, if not -1
+    Chan* c;   // or for c to have room, if send is set, or an atom
+    bool send;
+};
+Park* parked;
+int nparked = 0, maxparked = 0;
+Park parking;            // What the thread parked by a builtin waits for
+bool parkpending = false;
+Atom* stepping = 0;      // Exec of the thread being stepped
+
+// True if reading fd won't block, waiting up to timeout ms (-1 forever).
+// fdready - bool function
+bool fdready(int fd, int timeout) {
+#ifndef __riscv
+    struct pollfd p = {fd, POLLIN, 0};
+    return poll(&p, 1, timeout) > 0;
+#else
+    return true;
+#endif
+}
+bool linebuffered();
+// Lines already read from stdin make fd 0 ready, though it may have
+// nothing more to read.
+// parkready - bool function
+bool parkready(Park* p) {
+    if (p->c) {return (p->send) ? chanroom(p->c) : chanready(p->c) || p->c->error;}
+    if (!p->fd && linebuffered()) {return true;}
+    return fdready(p->fd, 0);
+}
+// Parks the thread being stepped on fd or c, if e is its exec.
+// Takes a reference to c either way.
+// parkthread - bool function
+bool parkthread(Atom* e, int fd, Chan* c, bool send) {
+    if (!e || e != stepping) {return false;}
+    parking = (Park) {0, fd, c ? chanref(c) : 0, send};
+    parkpending = true;
+    return true;
 }
+// park - void function
+void park(Atom* t) {
+    parked = growarray(parked, &maxparked, nparked+1, sizeof(Park));
+    parking.t = ref(t);
+    parked[nparked++] = parking;
+    parkpending = false;
+}
+// Index of t in parked, or -1.
+// findparked - int function
+int findparked(Atom* t) {
+    for (int i = 0; i < nparked; i++) {if (parked[i].t == t) {return i;}}
+    return -1;
+}
+// unpark - void function
+void unpark(int i) {
+    del(parked[i].t);
+    chanrelease(parked[i].c);
+    parked[i] = parked[--nparked];
+}
+// True if t is parked on something that still isn't ready.
+// stillparked - bool function
+bool stillparked(Atom* t) {
+    int i = findparked(t);
+    if (i < 0) {return false;}
+    if (!parkready(&parked[i])) {return true;}
+    unpark(i);
+    return false;
+}
+// True if a parked thread could run again.
+// parkedready - bool function
+bool parkedready() {
+    for (int i = 0; i < nparked; i++) {if (parkready(&parked[i])) {return true;}}
+    return false;
+}
+// Blocks until fd or one of the fds threads are parked on is ready.
+// False if there are no fds to wait for.  Stdin isn't polled while it
+// has lines buffered, since they won't show up there.
+// waitany - bool function
+bool waitany(int fd) {
+#ifndef __riscv
+    bool buffered = linebuffered();
+    struct pollfd p[nparked+1];
+    int n = 0;
+    if (fd >= 0) {
+        if (!fd && buffered) {return true;}
+        p[n++] = (struct pollfd) {fd, POLLIN, 0};
+    }
+    for (int i = 0; i < nparked; i++) {
+        if (!parked[i].fd && buffered) {return true;}
+        if (parked[i].fd >= 0) {p[n++] = (struct pollfd) {parked[i].fd, POLLIN, 0};}
+    }
+    if (!n) {return false;}
+    poll(p, n, -1);
+#endif
+    return true;
+}
+Error advancethreads();
+bool stagesready();
+// Runs the threads until what the main program waits for is ready.
+// False if nothing left could make it so.
+// waitfor - bool function
+bool waitfor(int fd, Chan* c, bool send) {
+    Park p = {0, fd, c, send};
+    while (!parkready(&p)) {
+        if (length(Threads) > nparked || parkedready() || stagesready()) {advancethreads();}
+        else if (!waitany(fd)) {return false;}
+    }
+    return true;
+}
+// parkflush - void function
+void parkflush() {
+    while (nparked) {unpark(nparked-1);}
+    if (parked) {reclaim(parked, maxparked*sizeof(Park));}
+    parked = 0;
+    maxparked = 0;
+}
+
 // run - bool function
 bool run(Atom* D, Atom* d, Atom* e, Atom* r) {
     if (!e || isempty(e)) {return false;}
     Error er = pulln(e);
     if (er.msg) {return false;}
     Atom* eaa = asA(er.d.a);
-    if (eaa->f == dots) {dot(D, d, e, r);}
+    if (eaa->f == dots) {
+        dot(D, d, e, r);
+        if (parkpending) {push(e, er.d.a);} // run it again once unparked
+    }
     else if (eaa->f == vects) {push(d, dupstr(eaa));}
     else {push(d, duplicate(eaa));}
     del(er.d.a);
     return true;
 }
-// arraydot - Error function
-Error arraydot(Atom* D, Atom* d, Atom* a, Atom* e, Atom* r) {
-    Error er = passA(d);
-    if (a->f == ends) {return er;}
-    if (!isend(a)) {er = arraydot(D, d, a->n, e, r);}
+
+#include "Jit.c"
+
+// Evaluator.
+// Blocks run on an explicit continuation stack instead of recursing on
+// the C stack.  Each frame is a block being run: its elements in program
+// order, and the cursor of the next one.  Element arrays of all frames
+// share one buffer, since frames are only ever pushed and popped.
+// Loops rerun a frame by moving its cursor back, so a block is laid out
+// once however many times it runs.
+typedef struct Frame Frame;
+struct Frame {
+    int base, len, pc; // Elements are code[base..base+len]
+    Atom* hold;        // Reference keeping the block alive
+    Atom* d;           // Working stack to return to when the block is done
+    Word again;        // Reruns left for `times`, or -1 for `while`
+    int test;          // For `while`, where the condition ends and the body starts
+};
+typedef struct Kont Kont;
+struct Kont {
+    Frame* f;
+    int len, maxlen;
+    Atom** code;
+    int codelen, codemaxlen;
+};
+
+// Lays the elements of the block held by `hold` out at the end of the
+// code, and returns how many there are.
+// Blocks store their last element first, so the elements are
+// laid out backward.
+// layout - int function
+int layout(Kont* k, Atom* hold) {
+    int n = length(hold);
+    k->code = growarray(k->code, &k->codemaxlen, k->codelen+n, sizeof(Atom*));
+    Atom* a = asA(hold);
+    for (int i = k->codelen+n-1; i >= k->codelen; i--) {
+        k->code[i] = a;
+        a = a->n;
+    }
+    k->codelen += n;
+    return n;
+}
+// Push a frame running the block held by `hold`.
+// pushframe - void function
+void pushframe(Kont* k, Atom* hold, Atom* d) {
+    k->f = growarray(k->f, &k->maxlen, k->len+1, sizeof(Frame));
+    TRACE(TRENTER, asA(hold));
+    int base = k->codelen;
+    k->f[k->len++] = (Frame) {base, layout(k, hold), 0, hold, d};
+}
+// Push a frame running the block held by `cond`, then, while it leaves a
+// nonzero word, the one held by `body` and `cond` again.  The frame
+// takes over the reference to cond only; body must outlive it.
+// pushwhile - void function
+void pushwhile(Kont* k, Atom* cond, Atom* body, Atom* d) {
+    pushframe(k, cond, d);
+    Frame* f = &k->f[k->len-1];
+    f->test = f->len;
+    f->len += layout(k, body);
+    f->again = -1;
+}
+// popframe - void function
+void popframe(Kont* k) {
+    Frame* f = &k->f[--k->len];
+    TRACE(TRLEAVE, asA(f->hold));
+    k->codelen = f->base;
+    del(f->hold);
+}
+// freekont - void function
+void freekont(Kont* k) {
+    while (k->len) {popframe(k);}
+    if (k->f) {reclaim(k->f, k->maxlen*sizeof(Frame));}
+    if (k->code) {reclaim(k->code, k->codemaxlen*sizeof(Atom*));}
+    *k = (Kont) {0};
+}
+
+// Executes the top of the working stack.
+// Funcs are called and names are resolved.  Blocks are grown onto the
+// exec stack e when there is one, and otherwise pushed as a frame on k.
+// A block called by the last element of a frame replaces that frame.
+// `site` is the dots element being run, if it is part of a block.
+// dispatch - Error function
+Error dispatch(Atom* D, Atom* e, Atom* r, Kont* k, Atom* site) {
+    Atom* d = traverselinks(D);
+    Atom* a = asA(d);
+    while (a && a->f == dots) {
+        pull(d);
+        d = traverselinks(D);
+        a = asA(d);
+        site = 0;
+    }
+    if (!a) {return passA(d);}
+    if (asV(a)) {return varrecscan(D, d, site);}
+    Func f = asF(a);
+    if (f) {
+        pull(d);
+        if (tracing) {return tracecall(f, D, d, e, r);}
+        return f(D, d, e, r);
+    }
+    if (!isA(a)) {return passA(d);}
+    if (isempty(a)) {pull(d); return passA(d);}
+    Error er = pulln(d);
     if (er.msg) {return er;}
-    if (a->f == dots) {return dot(D, d, e, r);}
-    d = er.d.a;
-    push(d, duplicate(a));
+    Atom* hold = er.d.a;
+#ifdef JIT
+    if (!e && !r && !tracing && jitcall(d, asA(hold))) {
+        del(hold);
+        return passA(d);
+    }
+#endif
+    if (e) {
+        growthreadexec(e, asA(hold));
+        del(hold);
+        return passA(d);
+    }
+    Atom* ret = d;
+    if (k->len && k->f[k->len-1].pc == k->f[k->len-1].len && !k->f[k->len-1].again) {
+        ret = k->f[k->len-1].d;
+        popframe(k);
+    }
+    pushframe(k, hold, ret);
     return passA(d);
 }
+Error pullfunc(Atom* D, Atom* d, Atom* e, Atom* r);
+Error duplicatefunc(Atom* D, Atom* d, Atom* e, Atom* r);
+Error addfunc(Atom* D, Atom* d, Atom* e, Atom* r);
+Error subfunc(Atom* D, Atom* d, Atom* e, Atom* r);
+Error mulfunc(Atom* D, Atom* d, Atom* e, Atom* r);
+Error dupn(Atom* d, Word w);
+// Superinstructions.
+// `N ,.`, `N ;.`, `N +.`, `N -.` and `N *.` in a block run as one step,
+// with N taken from the block instead of pushed and pulled back off d.
+// Only used with no record stack, where the two are indistinguishable.
+// False if f isn't one of them.
+// fused - bool function
+bool fused(Atom* d, Word w, Func f, Error* er) {
+    if (f == pullfunc) {
+        *er = pullx(d, w);
+        if (!er->msg) {*er = passA(d);}
+        return true;
+    }
+    if (f == duplicatefunc) {*er = dupn(d, w); return true;}
+    if (f != addfunc && f != subfunc && f != mulfunc) {return false;}
+    wordfail(asA(d));
+    Atom* a = owned(asA(d));
+    unsigned long long u = a ? a->d.w : pullw(d);
+    u = (f == addfunc) ? u + w : (f == subfunc) ? u - w : u * w;
+    if (a) {setword(a, u);}
+    else {pushw(d, u);}
+    *er = passA(d);
+    return true;
+}
+// Operand buffer.
+// The words a block pushes are held by eval as plain values in an array
+// instead of as atoms on d, and +, -, * and the fused forms above work
+// on them there, so arithmetic in a loop is index bumps with nothing
+// allocated, freed or relinked.  Words an operation needs from below
+// what's buffered are pulled off d into the bottom of the buffer, so a
+// loop's running total stays there from one round to the next.
+// Anything else the block does may look at d, so the buffer is pushed
+// onto d as atoms first, oldest first, as it is when the frame ends.
+// Like the fused forms it's only used with no record stack, and not
+// while tracing, which counts every push.
+#define WBUF 0x40
+typedef struct Wbuf Wbuf;
+struct Wbuf {
+    int n;
+    Word w[WBUF];
+};
+// wflush - void function
+void wflush(Wbuf* b, Atom* d) {
+    for (int i = 0; i < b->n; i++) {pushw(d, b->w[i]);}
+    b->n = 0;
+}
+// Pulls words off d into the bottom of the buffer until it holds n, if
+// d may be read.  False if d runs out of words first.
+// wbuffill - bool function
+bool wbuffill(Wbuf* b, Atom* d, Word n) {
+    if (n > WBUF) {return false;}
+    while (b->n < n) {
+        if (!d || isempty(d) || asA(d)->f != words) {return false;}
+        for (int i = b->n; i > 0; i--) {b->w[i] = b->w[i-1];}
+        b->w[0] = pullw(d);
+        b->n++;
+    }
+    return true;
+}
+// Runs f on the buffer, with N as w if counted, or else taking both
+// operands from the buffer, filled from d if it may be read.  False if
+// the operands aren't all words.
+// wbufop - bool function
+bool wbufop(Wbuf* b, Atom* d, Func f, Word w, bool counted) {
+    bool math = f == addfunc || f == subfunc || f == mulfunc;
+    if (!counted) {
+        if (!math || !wbuffill(b, d, 2)) {return false;}
+        w = b->w[--b->n];
+    }
+    if (math) {
+        if (!wbuffill(b, d, 1)) {return false;}
+        unsigned long long u = b->w[b->n-1];
+        b->w[b->n-1] = (f == addfunc) ? u + w : (f == subfunc) ? u - w : u * w;
+        return true;
+    }
+    if (f == pullfunc) {
+        if (w < 0 || !wbuffill(b, d, w)) {return false;}
+        b->n -= w;
+        return true;
+    }
+    if (f == duplicatefunc) {
+        if (w < 0 || !wbuffill(b, d, 1) || w > WBUF - b->n + 1) {return false;}
+        if (!w) {b->n--; return true;}
+        while (--w) {b->w[b->n] = b->w[b->n-1]; b->n++;}
+        return true;
+    }
+    return false;
+}
+// Runs frames until k is empty.
+// eval - Error function
+Error eval(Atom* D, Atom* d, Atom* r, Kont* k) {
+    Error er = passA(d);
+    Wbuf b;
+    b.n = 0;
+    while (k->len) {
+        Frame* f = &k->f[k->len-1];
+        if (f->again < 0 && f->pc == f->test) {
+            Word c;
+            if (b.n) {c = b.w[--b.n];}
+            else {
+                if (!asA(d) || asA(d)->f != words) {return fail("while needs a word from its condition");}
+                c = pullw(d);
+            }
+            if (!c) {f->again = 0; f->pc = f->len;}
+        }
+        if (f->pc == f->len) {
+            if (f->again) {
+                if (f->again > 0) {f->again--;}
+                f->pc = 0;
+                continue;
+            }
+            wflush(&b, d);
+            d = f->d;
+            er = passA(d);
+            popframe(k);
+            continue;
+        }
+        // A superinstruction can't reach past the condition of a `while`.
+        int end = (f->again < 0 && f->pc < f->test) ? f->test : f->len;
+        Atom* a = k->code[f->base + f->pc++];
+        bool fast = !r && !tracing;
+        Atom** c = &k->code[f->base + f->pc];
+        if (a->f == words && f->pc + 2 <= end && fast) {
+            Atom* from = (b.n || d == traverselinks(D)) ? d : 0;
+            if (c[0]->f == funcs && c[1]->f == dots && wbufop(&b, from, c[0]->d.f, a->d.w, true)) {
+                f->pc += 2;
+                continue;
+            }
+            if (c[0]->f == funcs && c[1]->f == dots && !b.n && from) {
+                Error fe;
+                if (fused(d, a->d.w, c[0]->d.f, &fe)) {
+                    if (fe.msg) {return fe;}
+                    f->pc += 2;
+                    er = fe;
+                    d = fe.d.a;
+                    continue;
+                }
+            }
+        }
+        if (a->f == words && fast && b.n < WBUF && (b.n || d == traverselinks(D))) {
+            b.w[b.n++] = a->d.w;
+            continue;
+        }
+        if (a->f == funcs && f->pc + 1 <= end && c[0]->f == dots && fast
+            && wbufop(&b, (b.n || d == traverselinks(D)) ? d : 0, a->d.f, 0, false)) {
+            f->pc++;
+            continue;
+        }
+        wflush(&b, d);
+        if (a->f != dots) {push(d, duplicate(a)); continue;}
+        er = dispatch(D, 0, r, k, a);
+        if (er.msg) {return er;}
+        d = er.d.a;
+    }
+    return er;
+}
 // dot - Error function
 Error dot(Atom* D, Atom* d, Atom* e, Atom* r) {
     atomfail(D);
-    d = traverselinks(D);
-    Atom* a = asA(d);
-    if (asV(a)) {return varrecscanfunc(D, d, e, r);}
-    Func f = asF(a);
-    if (f) {pull(d); return f(D, d, e, r);}
-    if (isA(a)) {
-        if (isempty(a)) {pull(d); return passA(d);}
-        Error er = pulln(d);
-        if (er.msg) {return er;}
-        Atom* temp = er.d.a;
-        a = asA(a);
-        if (e) {growthreadexec(e, a);}
-        else {er = arraydot(D, d, a, e, r);}
-        del(temp);
-        if (er.msg) {return er;}
-    }
-    else if (a->f == dots) {pull(d); return dot(D, d, e, r);}
-    return passA(d);
+    Kont k = {0};
+    Error er = dispatch(D, e, r, &k, 0);
+    if (!er.msg && k.len) {er = eval(D, er.d.a, r, &k);}
+    freekont(&k);
+    return er;
 }
 Atom* func(Func f);
+// Finds what c is bound to from a.  Builtins come from the table in one
+// probe, unless the program may have bound the name itself.
+// lookup - Atom* function
+Atom* lookup(Atom* a, char* c) {
+    int i = builtinindex(c);
+    if (i >= 0 && !shadowed[i]) {return &builtinatoms[i];}
+    Atom* v = scan(a, 0, c);
+    if (!v && i >= 0) {return &builtinatoms[i];}
+    return v;
+}
+// Nesting of tokens.  Only the outermost runs between tokens with no
+// builtin underway, so that's where cycles are collected.
+int tokendepth = 0;
 // token - bool function
 bool token(Atom* D, Atom* d, Atom* e, Atom* r, Atom* s, Error* er) {
     if (discardwhitespace(s)) {return false;}
-    Vect* v = asV(s);
-    if (v->v[0] == '"') {push(d, charptostr(s, '"', '"'));}
-    else if (v->v[0] == '(') {del(ref(charptostr(s, '(', ')')));}
-    else if (v->v[0] == '.') {
-        if (v->v[1] != '.') {
+    Span v = span(s);
+    if (tracing) {
+        traceevent(TRSTACK, tracepushes << 32 | (tracepulls & 0xffffffff));
+        traceevent(TRTOKEN, tracetoken(v.v));
+    }
+    if (v.v[0] == '"') {push(d, shadow(charptostr(s, '"', '"')));}
+    else if (v.v[0] == '(') {del(ref(charptostr(s, '(', ')')));}
+    else if (v.v[0] == '.') {
+        if (v.len < 2 || v.v[1] != '.') {
+            if (tokendepth == 1) {PHASE(PHEXEC);}
             *er = dot(D, d, e, r);
+            if (tokendepth == 1) {PHASE(PHTOKEN);}
             if (er->msg) {return false;}
             d = traverselinks(D);
         }
@@ -823,12 +1983,12 @@ bool token(Atom* D, Atom* d, Atom* e, Atom* r, Atom* s, Error* er) {
         int i = strindexofnot(s, ".");
         discardn(s, i);
     }
-    else if (v->v[0] == ':') {
+    else if (v.v[0] == ':') {
         Atom* a = splitonchars(s, whitespace ".");
         if (equstr(asV(a)->v, ":")) {
             push(d, func(scanfunc));
         }
-        else {push(d, str(asV(a)->v+1));}
+        else {push(d, shadow(str(asV(a)->v+1)));}
         del(ref(a));
     }
     else {
@@ -841,8 +2001,8 @@ bool token(Atom* D, Atom* d, Atom* e, Atom* r, Atom* s, Error* er) {
         Atom* w = strtonum(a);
         if (w) {del(ref(a)); push(d, w); return true;}
         Atom* var;
-        if (!asA(d)) {var = scan(d, 0, asV(a)->v);}
-        else {var = scan(asA(d), 0, asV(a)->v);}
+        if (!asA(d)) {var = lookup(d, asV(a)->v);}
+        else {var = lookup(asA(d), asV(a)->v);}
         if (var) {push(d, duplicate(var));}
         else {
             *er = fail(asV(addstrch(str(asV(a)->v), " not found."))->v);
@@ -860,6 +2020,117 @@ Atom* runall(Atom* D, Atom* e, Atom* r) {
     return d;
 }
 
+// Pipelines.
+// Each stage of a pipeline takes atoms from one channel, runs its block
+// on each, and sends whatever the block leaves down the next channel.
+// Stages are stepped with the threads, a batch of atoms at a time on one
+// continuation stack, and only take an atom when the channel after them
+// has room, so a slow stage holds back the ones before it.  A stage
+// whose block fails poisons the channel after it and stops, and each
+// stage after it passes the poison on once it has nothing left to send.
+// A stage is dropped, releasing its channels, once nothing more can
+// reach it and it has sent all it had: its input is poisoned, or held
+// by nothing else, and drained.  So is one that can't send again, with
+// its output poisoned, or full and held by nothing else to take from.
+#define PIPEBATCH 0x20
+typedef struct Stage Stage;
+struct Stage {
+    Atom* block;
+    Chan* in;
+    Chan* out;
+    Atom* s;   // Stack the block runs on, then what it left, oldest on top
+    Kont k;
+};
+Stage** stages; // Each on its own, so a stage adding stages doesn't move it
+int nstages = 0, maxstages = 0;
+bool staging = false; // A stage is running, so stages aren't reentered
+
+void reversestack(Atom* a);
+// stageready - bool function
+bool stageready(Stage* g) {
+    if (g->out->error || !chanroom(g->out)) {return false;}
+    return !isempty(g->s) || chanready(g->in);
+}
+// stagesready - bool function
+bool stagesready() {
+    if (staging) {return false;}
+    for (int i = 0; i < nstages; i++) {if (stageready(stages[i])) {return true;}}
+    return false;
+}
+// Moves up to PIPEBATCH atoms through g.
+// stepstage - void function
+void stepstage(Stage* g) {
+    if (chanfailed(g->in) && isempty(g->s)) {chanpoison(g->out, g->in->error);}
+    for (int n = 0; n < PIPEBATCH && stageready(g); ) {
+        if (!isempty(g->s)) {
+            Error er = pulln(g->s);
+            chansend(g->out, ref(duplicate(er.d.a)));
+            del(er.d.a);
+            continue;
+        }
+        Atom* a = chanrecv(g->in);
+        push(g->s, a);
+        del(a);
+        push(g->s, duplicate(g->block));
+        Error er = dispatch(g->s, 0, 0, &g->k, 0);
+        if (!er.msg && g->k.len) {er = eval(g->s, er.d.a, 0, &g->k);}
+        if (er.msg) {
+            chanpoison(g->out, er.msg);
+            del(er.d.a);
+            while (g->k.len) {popframe(&g->k);}
+            while (!isempty(g->s)) {pull(g->s);}
+        }
+        reversestack(g->s);
+        n++;
+    }
+}
+// True once g can do no more, passing on the poison of its input.
+// stagedone - bool function
+bool stagedone(Stage* g) {
+    if (g->out->error || (!chanshared(g->out) && !chanroom(g->out))) {return true;}
+    if (!isempty(g->s) || chanready(g->in)) {return false;}
+    if (g->in->error) {chanpoison(g->out, g->in->error); return true;}
+    return !chanshared(g->in);
+}
+// freestage - void function
+void freestage(Stage* g) {
+    freekont(&g->k);
+    del(g->s);
+    del(g->block);
+    chanrelease(g->in);
+    chanrelease(g->out);
+    reclaim(g, sizeof(Stage));
+}
+// Steps every stage, then drops the ones that are done, in order.
+// Stages a stage adds are stepped in the same round.
+// advancestages - void function
+void advancestages() {
+    if (staging) {return;}
+    staging = true;
+    for (int i = 0; i < nstages; i++) {stepstage(stages[i]);}
+    int n = 0;
+    for (int i = 0; i < nstages; i++) {
+        if (stagedone(stages[i])) {freestage(stages[i]);}
+        else {stages[n++] = stages[i];}
+    }
+    nstages = n;
+    staging = false;
+}
+// addstage - void function
+void addstage(Atom* block, Chan* in, Chan* out) {
+    stages = growarray(stages, &maxstages, nstages+1, sizeof(Stage*));
+    Stage* g = malloc(sizeof(Stage));
+    *g = (Stage) {ref(duplicate(block)), chanref(in), chanref(out), ref(new(atoms)), {0}};
+    stages[nstages++] = g;
+}
+// stageflush - void function
+void stageflush() {
+    while (nstages) {freestage(stages[--nstages]);}
+    if (stages) {reclaim(stages, maxstages*sizeof(Stage*));}
+    stages = 0;
+    maxstages = 0;
+}
+
 Error stepfunc(Atom* D, Atom* d, Atom* e, Atom* r);
 // advancethreads - Error function
 Error advancethreads() {
@@ -868,14 +2139,27 @@ Error advancethreads() {
     Error e;
     while (t) {
         if (isempty(t)) {break;}
+        tracethread++;
+        if (stillparked(t)) {
+            if (isend(t)) {break;}
+            t = t->n;
+            continue;
+        }
+        TRACE(TRTHREAD, tracethread);
         push(t, func(stepfunc));
         e = dot(t, t, 0, 0);
-        if (e.msg) {return e;}
+        if (e.msg) {tracethread = 0; return e;}
+        if (parkpending) {park(t);}
         if (isempty(asA(t))) {pull(Threads); break;}
         if (isempty(asA(t->n))) {removeafter(t);}
         if (isend(t)) {break;}
         t = t->n;
     }
+    advancestages();
+    if (tracethread) {
+        tracethread = 0;
+        TRACE(TRTHREAD, 0);
+    }
     del(d);
     return passA(0);
 }
@@ -885,9 +2169,17 @@ Error tokens(Atom* D, Atom* e, Atom* r, Atom* s) {
     atomfail(D);
     Error er = passA(D);
     Atom* d;
-    while (token(D, runall(D, e, r), e, r, s, &er)) {
+    tokendepth++;
+    while (true) {
+        if (tokendepth == 1) {PHASE(PHEXEC);}
+        d = runall(D, e, r);
+        if (tokendepth == 1) {PHASE(PHTOKEN);}
+        if (!token(D, d, e, r, s, &er)) {break;}
+        if (tokendepth == 1) {PHASE(PHEXEC);}
         advancethreads();
+        if (tokendepth == 1) {safepoint();}
     }
+    tokendepth--;
     return er;
 }
 // addvar - void function
@@ -920,11 +2212,26 @@ void mathfunc(Word* x, Word* y, Atom* d, Atom* r) {
     *y = rw->n->d.w;
 }
 
+// The word under the top, if it can take the result in place.  The top
+// holds it, so the top must be unshared too: a list shared through its
+// head shares every word in it.
+// mathtarget - Atom* function
+Atom* mathtarget(Atom* d, Atom* r) {
+    if (r || isempty(d) || isend(asA(d)) || asA(d)->f != words || asA(d)->r != 1) {return 0;}
+    return owned(asA(d)->n);
+}
+
 #define mathfuncbuild(name, op) \
 Error name ## func(Atom* D, Atom* d, Atom* e, Atom* r) { \
     Word x, y; \
+    Atom* t = mathtarget(d, r); \
+    if (t) { \
+        x = pullw(d); \
+        setword(t, (unsigned long long) t->d.w op x); \
+        return passA(d); \
+    } \
     mathfunc(&x, &y, d, r); \
-    pushw(d, y op x); \
+    pushw(d, (unsigned long long) y op x); \
     return passA(d); \
 }
 mathfuncbuild(add, +);
@@ -940,12 +2247,38 @@ Error undofunc(Atom* D, Atom* d, Atom* e, Atom* r) {
     return passA(d);
 }
 
+// checkpointfunc - Error function
+Error checkpointfunc(Atom* D, Atom* d, Atom* e, Atom* r) {
+    if (ncheckpoints == CHECKPOINTS) {return fail("too many open checkpoints");}
+    checkpoints[ncheckpoints++] = jtop;
+    return passA(d);
+}
+
+// rollbackfunc - Error function
+Error rollbackfunc(Atom* D, Atom* d, Atom* e, Atom* r) {
+    if (!ncheckpoints) {return fail("no open checkpoint");}
+    Word c = checkpoints[--ncheckpoints];
+    if (c < jbase) {return fail("checkpoint was dropped from the journal");}
+    journalrollback(c);
+    if (!ncheckpoints) {journalrelease();}
+    return passA(d);
+}
+
+// commitfunc - Error function
+Error commitfunc(Atom* D, Atom* d, Atom* e, Atom* r) {
+    if (!ncheckpoints) {return fail("no open checkpoint");}
+    if (!--ncheckpoints) {journalrelease();}
+    return passA(d);
+}
+
 // enterlink - Error function
 Error enterlink(Atom* d) {
     if (isempty(d)) {return fail("d is empty");}
     Atom* a = asA(d);
     atomfail(a);
-    a->f = links;
+    if (isfrozen(a) || isfrozen(asA(a))) {return fail("stack is frozen");}
+    journalatom(a);
+    setform(a, links);
     return passA(d);
 }
 
@@ -955,15 +2288,25 @@ Error getlen(Atom* D, Atom* d, Atom* e, Atom* r) {
     return passA(d);
 }
 
+// A thread's stacks change as it runs, so a frozen one is refused
+// before any of it runs.
+// threadfrozen - bool function
+bool threadfrozen(Atom* a) {return isfrozen(a) || (isA(a) && isfrozen(asA(a)));}
 // stepfunc - Error function
 Error stepfunc(Atom* D, Atom* d, Atom* e, Atom* r) {
+    if (length(d) < 2) {return fail("step needs a data and an exec stack");}
+    if (threadfrozen(asA(d)) || threadfrozen(asA(d)->n)) {return fail("stack is frozen");}
     d = asA(d);
+    stepping = d;
     run(asA(d->n), traverselinks(asA(d->n)), d, r);
+    stepping = 0;
     return passA(d);
 }
 
 // growexecfunc - Error function
 Error growexecfunc(Atom* D, Atom* d, Atom* e, Atom* r) {
+    if (length(d) < 2) {return fail("growexec needs an exec stack and a block");}
+    if (threadfrozen(asA(d)->n)) {return fail("stack is frozen");}
     Atom* a = ref(asA(d));
     growthreadexec(a->n, asA(a));
     del(a);
@@ -973,7 +2316,11 @@ Error growexecfunc(Atom* D, Atom* d, Atom* e, Atom* r) {
 
 // runfunc - Error function
 Error runfunc(Atom* D, Atom* d, Atom* e, Atom* r) {
+    if (length(d) < 3) {return fail("run needs a record, a data and an exec stack");}
     r = asA(d)->n->n;
+    if (threadfrozen(asA(d)) || threadfrozen(asA(d)->n) || (isA(r) && threadfrozen(r))) {
+        return fail("stack is frozen");
+    }
     r = (isA(r)) ? asA(r) : 0;
     runall(asA(asA(d)->n), asA(d), r);
     return passA(d);
@@ -987,6 +2334,7 @@ Error detachfunc(Atom* D, Atom* d, Atom* e, Atom* r) {
 
 // choosefunc - Error function
 Error choosefunc(Atom* D, Atom* d, Atom* e, Atom* r) {
+    if (length(d) < 3) {return fail("? needs a word and two elements");}
     Atom* w = get(asA(d), 2);
     wordfail(w);
     if (asW(w)) {swap(d);}
@@ -994,27 +2342,356 @@ Error choosefunc(Atom* D, Atom* d, Atom* e, Atom* r) {
     return passA(d);
 }
 
+// Loops.
+// `times` and `while` run their blocks on a frame of their own that
+// moves its cursor back for each round, so the blocks are laid out once
+// and nothing is allocated per round.  A thread being stepped takes one
+// round per step instead, and leaves the rest of the loop on its exec
+// stack as `block count times.` or `cond body while.`, so other threads
+// run between rounds.
+// Leaves `a b f.` to run next on the exec stack e.
+// pushagain - void function
+void pushagain(Atom* e, Atom* a, Atom* b, Func f) {
+    Atom* c[] = {new(dots), func(f), b, a};
+    for (int i = 0; i < 4; i++) {pushnew(e, atoms, (data) c[i]);}
+}
+// Runs the frames pushed on k to the end.
+// runkont - Error function
+Error runkont(Atom* D, Atom* d, Atom* r, Kont* k) {
+    Error er = eval(D, d, r, k);
+    freekont(k);
+    return er;
+}
+// Runs the block under the count on top count times.
+// timesfunc - Error function
+Error timesfunc(Atom* D, Atom* d, Atom* e, Atom* r) {
+    if (length(d) < 2 || asA(d)->f != words || !isA(asA(d)->n)) {
+        return fail("times needs a block and a count");
+    }
+    Word n = pullw(d);
+    Atom* hold = pulln(d).d.a;
+    if (n <= 0) {del(hold); return passA(d);}
+    Kont k = {0};
+    if (e && n > 1) {pushagain(e, hold, makew(n-1), timesfunc);}
+    pushframe(&k, hold, d);
+    if (!e) {k.f[0].again = n-1;}
+    return runkont(D, d, r, &k);
+}
+// Runs the block on top for as long as the block under it leaves a
+// nonzero word.
+// whilefunc - Error function
+Error whilefunc(Atom* D, Atom* d, Atom* e, Atom* r) {
+    if (length(d) < 2 || !isA(asA(d)) || !isA(asA(d)->n)) {
+        return fail("while needs a condition block and a body block");
+    }
+    Atom* body = pulln(d).d.a;
+    Atom* cond = pulln(d).d.a;
+    Kont k = {0};
+    Error er;
+    if (!e) {
+        pushwhile(&k, cond, body, d);
+        er = runkont(D, d, r, &k);
+    }
+    else {
+        pushframe(&k, ref(cond), d);
+        er = runkont(D, d, r, &k);
+        d = er.d.a;
+        if (!er.msg && (!asA(d) || asA(d)->f != words)) {er = fail("while needs a word from its condition");}
+        if (!er.msg && pullw(d)) {
+            pushagain(e, cond, body, whilefunc);
+            pushframe(&k, ref(body), d);
+            er = runkont(D, d, r, &k);
+        }
+        del(cond);
+    }
+    del(body);
+    return er;
+}
+
+// Shape hashes.
+// Hashes are cached by the head of the list they cover, and every atom
+// they cover is marked HASHED, so any change to one retires them all
+// through journalatom (see shapever).  An entry also remembers the last
+// list it was found the same shape as.  Entries hold references.
+// A compare only hashes when neither list has a hash yet, and then once:
+// the walk that confirms the lists match has to be made anyway, and
+// lists of the same shape share a hash.
+#define SHAPECACHELEN 0x100
+typedef struct Shapehash Shapehash;
+struct Shapehash {Atom* a; Atom* like; Word ver; Word h;};
+Shapehash shapehashes[SHAPECACHELEN];
+
+#define mixhash(h, x) (((h) ^ (Word) (x)) * 1099511628211ull)
+// Hashes the forms of a and everything under it, and marks them HASHED.
+// hashshape - Word function
+Word hashshape(Atom* a) {
+    Word h = 14695981039346656037ull;
+    Atom** stack = 0;
+    int top = 0, maxlen = 0;
+    while (true) {
+        while (a) {
+            asV(a);
+            a->m |= HASHED;
+            h = mixhash(h, a->f + 2);
+            Atom* next = isend(a) ? 0 : a->n;
+            if (isA(a) && asA(a)) {
+                stack = growarray(stack, &maxlen, top + 1, sizeof(Atom*));
+                stack[top++] = next;
+                next = asA(a);
+            }
+            else if (isA(a)) {h = mixhash(h, 0);}
+            a = next;
+        }
+        h = mixhash(h, 1);
+        if (!top) {break;}
+        a = stack[--top];
+    }
+    if (stack) {reclaim(stack, maxlen*sizeof(Atom*));}
+    return h;
+}
+// The current entry for a, or 0.
+// shapecached - Shapehash* function
+Shapehash* shapecached(Atom* a) {
+    Shapehash* sh = &shapehashes[((Word) a >> 4) % SHAPECACHELEN];
+    return (sh->a == a && sh->ver == shapever) ? sh : 0;
+}
+// Caches h as a's hash, and like as the last list it matched.
+// shapestore - void function
+void shapestore(Atom* a, Word h, Atom* like) {
+    Shapehash* sh = &shapehashes[((Word) a >> 4) % SHAPECACHELEN];
+    ref(a); ref(like);
+    del(sh->a); del(sh->like);
+    *sh = (Shapehash) {a, like, shapever, h};
+}
+// shapeflush - void function
+void shapeflush() {
+    for (int i = 0; i < SHAPECACHELEN; i++) {
+        del(shapehashes[i].a); del(shapehashes[i].like);
+        shapehashes[i] = (Shapehash) {0};
+    }
+}
+// Walks a and b side by side, marking what it passes HASHED.  Lists of
+// different lengths differ.
+// shapewalk - bool function
+bool shapewalk(Atom* a, Atom* b) {
+    Atom** stack = 0;
+    int top = 0, maxlen = 0;
+    bool same = true;
+    while (true) {
+        if (a != b) {
+            asV(a); asV(b);
+            if (!a || !b || a->f != b->f || a->e != b->e) {same = false; break;}
+            a->m |= HASHED;
+            b->m |= HASHED;
+            Atom* an = isend(a) ? 0 : a->n;
+            Atom* bn = isend(b) ? 0 : b->n;
+            if (isA(a) && asA(a) != asA(b)) {
+                if (an) {
+                    stack = growarray(stack, &maxlen, top + 2, sizeof(Atom*));
+                    stack[top++] = an;
+                    stack[top++] = bn;
+                }
+                a = asA(a); b = asA(b);
+                continue;
+            }
+            if (an) {a = an; b = bn; continue;}
+        }
+        if (!top) {break;}
+        b = stack[--top];
+        a = stack[--top];
+    }
+    if (stack) {reclaim(stack, maxlen*sizeof(Atom*));}
+    return same;
+}
 // shapecompare - bool function
 bool shapecompare(Atom* a, Atom* b) {
-    if (a == 0 && b == 0) {return true;}
-    if (a == 0 || b == 0) {return false;}
-    if (a->f != b->f) {return false;}
-    if (isA(a) && !shapecompare(asA(a), asA(b))) {return false;}
-    if (isend(a) && isend(b)) {return true;}
-    return shapecompare(a->n, b->n);
+    if (a == b) {return true;}
+    if (!a || !b) {return false;}
+    Shapehash* sa = shapecached(a);
+    Shapehash* sb = shapecached(b);
+    if (sa && sa->like == b) {return true;}
+    if (sa && sb && sa->h != sb->h) {return false;}
+    if (!shapewalk(a, b)) {return false;}
+    Word h = sa ? sa->h : sb ? sb->h : hashshape(a);
+    if (!sb) {shapestore(b, h, 0);}
+    shapestore(a, h, b);
+    return true;
 }
 // shapecomparefunc - Error function
 Error shapecomparefunc(Atom* D, Atom* d, Atom* e, Atom* r) {
     Atom* a = asA(d);
     Atom* b = a->n;
+    asV(a); asV(b);
     if (a->f != b->f) {pushw(d, 0);}
     else {pushw(d, shapecompare(asA(a), asA(b)));}
     return passA(d);
 }
 
+// Interned structures.
+// freeze rebuilds a structure bottom up out of canonical atoms, one per
+// form, value and next atom, so equal frozen structures are the same
+// atoms.  Frozen tails have no parent pointer, so a frozen block can't
+// see the scopes around it.  The table holds a reference to each atom
+// and drops the ones nothing else holds whenever it has to grow.
+Atom** interned = 0;
+int ninterned = 0, maxinterned = 0;
+
+// internhash - Word function
+Word internhash(form f, data d, Atom* n) {
+    Word h = mixhash(14695981039346656037ull, f);
+    if (f == vects) {for (int i = 0; i < d.v->len; i++) {h = mixhash(h, d.v->v[i]);}}
+    else if (f != dots && f != ends) {h = mixhash(h, d.w);}
+    return mixhash(h, n);
+}
+// interns - bool function
+bool interns(Atom* a, form f, data d, Atom* n) {
+    if (a->f != f || (a->e ? 0 : a->n) != n) {return false;}
+    if (f == vects) {return equvect(a->d.v, d.v);}
+    if (f == dots || f == ends) {return true;}
+    return a->d.w == d.w;
+}
+// internslot - Atom** function
+Atom** internslot(Atom** table, int len, Word h) {
+    int i = h & (len - 1);
+    while (table[i]) {i = (i + 1) & (len - 1);}
+    return &table[i];
+}
+// Drops entries held only by the table, and makes room for one more.
+// growinterned - void function
+void growinterned() {
+    if (2*(ninterned + 1) <= maxinterned) {return;}
+    for (int i = 0; i < maxinterned; i++) {
+        Atom* a = interned[i];
+        if (a && a->r == 1) {interned[i] = 0; ninterned--; del(a);}
+    }
+    int len = (maxinterned) ? maxinterned : 0x40;
+    while (4*(ninterned + 1) > len) {len *= 2;}
+    Atom** table = malloc(len*sizeof(Atom*));
+    for (int i = 0; i < len; i++) {table[i] = 0;}
+    for (int i = 0; i < maxinterned; i++) {
+        Atom* a = interned[i];
+        if (a) {*internslot(table, len, internhash(a->f, a->d, (a->e) ? 0 : a->n)) = a;}
+    }
+    if (interned) {reclaim(interned, maxinterned*sizeof(Atom*));}
+    interned = table;
+    maxinterned = len;
+}
+// The canonical atom of form f holding d, followed by n.
+// Takes over d's vect, or a reference to d's atom or channel.
+// intern - Atom* function
+Atom* intern(form f, data d, Atom* n) {
+    growinterned();
+    Word h = internhash(f, d, n);
+    int i = h & (maxinterned - 1);
+    for (; interned[i]; i = (i + 1) & (maxinterned - 1)) {
+        Atom* a = interned[i];
+        if (interns(a, f, d, n)) {
+            if (f == vects) {freevect(d.v);}
+            if (f == chans) {chanrelease(d.c);}
+            if (f == atoms || f == links || f == execs) {del(d.a);}
+            return a;
+        }
+    }
+    Atom* a = new(f);
+    a->d = d;
+    if (n) {a->n = ref(n); a->e = false;}
+    a->m = FROZEN;
+    interned[i] = ref(a);
+    ninterned++;
+    return a;
+}
+// Canonical copy of the list starting at a, with a reference held,
+// so that growing the table can't drop it half built.
+// freezelist - Atom* function
+Atom* freezelist(Atom* a) {
+    if (!a || isfrozen(a)) {return ref(a);}
+    if (a->f == ends) {return ref(intern(ends, (data) 0ll, 0));}
+    Revview v = revview(a, true);
+    Atom* n = 0;
+    for (int i = 0; i < v.len; i++) {
+        Atom* c = v.a[i];
+        asV(c);
+        data d = c->d;
+        if (c->f == vects) {d.v = dupvect(d.v);}
+        if (c->f == chans) {chanref(d.c);}
+        if (isA(c)) {d.a = freezelist(asA(c));}
+        Atom* m = ref(intern(c->f, d, n));
+        del(n);
+        n = m;
+    }
+    freerevview(&v);
+    return n;
+}
+// freezeflush - void function
+void freezeflush() {
+    for (int i = 0; i < maxinterned; i++) {del(interned[i]);}
+    if (interned) {reclaim(interned, maxinterned*sizeof(Atom*));}
+    interned = 0;
+    ninterned = maxinterned = 0;
+}
+// freezefunc - Error function
+Error freezefunc(Atom* D, Atom* d, Atom* e, Atom* r) {
+    if (isempty(d)) {return fail("d is empty");}
+    Atom* a = asA(d);
+    if (!isA(a)) {return fail("target is not pointable");}
+    Atom* n = freezelist(asA(a));
+    tset(a, n);
+    del(n);
+    return passA(d);
+}
+// Returns true if a and b hold equal values.
+// Frozen structures are equal only when they are the same atoms.
+// equal - bool function
+bool equal(Atom* a, Atom* b) {
+    Atom** stack = 0;
+    int top = 0, maxlen = 0;
+    bool same = true;
+    while (true) {
+        if (a != b) {
+            asV(a); asV(b);
+            if (!a || !b || a->f != b->f || a->e != b->e) {same = false; break;}
+            if (isfrozen(a) && isfrozen(b)) {same = false; break;}
+            if (a->f == vects) {same = equvect(a->d.v, b->d.v);}
+            else if (a->f == words || a->f == funcs || a->f == chans) {same = a->d.w == b->d.w;}
+            if (!same) {break;}
+            Atom* an = isend(a) ? 0 : a->n;
+            Atom* bn = isend(b) ? 0 : b->n;
+            if (isA(a) && asA(a) != asA(b)) {
+                if (an) {
+                    stack = growarray(stack, &maxlen, top + 2, sizeof(Atom*));
+                    stack[top++] = an;
+                    stack[top++] = bn;
+                }
+                a = asA(a); b = asA(b);
+                continue;
+            }
+            if (an) {a = an; b = bn; continue;}
+        }
+        if (!top) {break;}
+        b = stack[--top];
+        a = stack[--top];
+    }
+    if (stack) {reclaim(stack, maxlen*sizeof(Atom*));}
+    return same;
+}
+// equalfunc - Error function
+Error equalfunc(Atom* D, Atom* d, Atom* e, Atom* r) {
+    Atom* a = asA(d);
+    if (!a || isend(a)) {return fail("Not two elements to compare.");}
+    Atom* b = a->n;
+    bool same = a->f == b->f;
+    if (isstr(a) && isstr(b)) {same = equspan(span(a), span(b));}
+    else if (same && isA(a)) {same = equal(asA(a), asA(b));}
+    else if (same && a->f != dots) {same = a->d.w == b->d.w;}
+    pull(d);
+    pull(d);
+    pushw(d, same);
+    return passA(d);
+}
+
 // assertfunc - Error function
 Error assertfunc(Atom* D, Atom* d, Atom* e, Atom* r) {
-    if (asW(asA(d))) {return fail(asA(d)->n->d.v->v);}
+    if (asW(asA(d))) {return fail(asV(asA(d)->n)->v);}
     pullx(d, 2);
     return passA(d);
 }
@@ -1023,7 +2700,11 @@ Error assertfunc(Atom* D, Atom* d, Atom* e, Atom* r) {
 Error duplicatefunc(Atom* D, Atom* d, Atom* e, Atom* r) {
     Error er = pulld(d);
     if (er.msg) {return er;}
-    Word w = er.d.w;
+    return dupn(d, er.d.w);
+}
+// Leaves w copies of the top of d, so none pops it.
+// dupn - Error function
+Error dupn(Atom* d, Word w) {
     if (!w) {pull(d); return passA(d);}
     while (--w) {push(d, duplicate(asA(d)));}
     return passA(d);
@@ -1033,7 +2714,9 @@ Error duplicatefunc(Atom* D, Atom* d, Atom* e, Atom* r) {
 Error pullfunc(Atom* D, Atom* d, Atom* e, Atom* r) {
     Error er = pulld(d);
     if (er.msg) {return er;}
-    return pullx(d, er.d.w);
+    er = pullx(d, er.d.w);
+    if (er.msg) {return er;}
+    return passA(d);
 }
 
 // newlink - Error function
@@ -1041,7 +2724,9 @@ Error newlink(Atom* D, Atom* d, Atom* e, Atom* r) {
     if (isempty(d)) {return fail("d is empty");}
     Atom* a = asA(d);
     atomfail(a);
-    a->f = links;
+    if (isfrozen(a) || isfrozen(asA(a))) {return fail("stack is frozen");}
+    journalatom(a);
+    setform(a, links);
     if (a->d.a == 0) {pushend(a, a);}
     return passA(a); // note a not d
 }
@@ -1049,7 +2734,8 @@ Error newlink(Atom* D, Atom* d, Atom* e, Atom* r) {
 // closelink - Error function
 Error closelink(Atom* D, Atom* d, Atom* e, Atom* r) {
     if (d->f != links) {return fail("d is not a link");}
-    d->f = atoms;
+    journalatom(d);
+    setform(d, atoms);
     return passA(traverselinks(D));
 }
 
@@ -1094,13 +2780,253 @@ Error printfunc(Atom* D, Atom* d, Atom* e, Atom* r) {
     return passA(d);
 }
 
+// basefunc - Error function
+Error basefunc(Atom* D, Atom* d, Atom* e, Atom* r) {
+    if (isempty(d)) {return fail("d is empty");}
+    wordfail(asA(d));
+    Word b = asW(asA(d));
+    if (b < 2 || b > 36) {return fail("base must be between 2 and 36");}
+    numbase = b;
+    pull(d);
+    return passA(d);
+}
+#define NMEMSTATS (ends+1 + 7)
+char* formnames[] = {"atoms", "links", "execs", "words", "funcs", "vects", "chans", "ropes", "slices", "dots", "ends"};
+char* memstatnames[] = {"live", "peak", "made", "vectbytes", "vectpeak", "madepersec", "collected"};
+// Takes a snapshot of the memory counters, named by formnames then
+// memstatnames.  madepersec is atoms made per second of CPU time, and
+// collected counts atoms the cycle collector reclaimed.
+// memstats - void function
+void memstats(Word* stats) {
+    for (int i = 0; i <= ends; i++) {stats[i] = formcounts[i];}
+    Word* s = stats + ends+1;
+    s[0] = atomslive;
+    s[1] = atompeak;
+    s[2] = atomsmade;
+    s[3] = vectbytes;
+    s[4] = vectpeak;
+    s[5] = 0;
+#ifndef __riscv
+    clock_t t = clock();
+    if (t > 0) {s[5] = (double) atomsmade * CLOCKS_PER_SEC / t;}
+#endif
+    s[6] = cyclesfreed;
+}
+// statname - char* function
+char* statname(int i) {return (i <= ends) ? formnames[i] : memstatnames[i - (ends+1)];}
+// collectfunc - Error function
+Error collectfunc(Atom* D, Atom* d, Atom* e, Atom* r) {
+    return passA(pushw(d, collectcycles()));
+}
+// Writes the trace so far to the file named on top.
+// tracedumpfunc - Error function
+Error tracedumpfunc(Atom* D, Atom* d, Atom* e, Atom* r) {
+    if (isempty(d)) {return fail("d is empty");}
+    vectfail(asA(d));
+    if (!tracing) {return fail("tracing is off, set FJTRACE");}
+#ifndef __riscv
+    if (!tracewrite(asV(asA(d))->v)) {return fail("cannot write trace");}
+#endif
+    pull(d);
+    return passA(d);
+}
+// memstatsfunc - Error function
+Error memstatsfunc(Atom* D, Atom* d, Atom* e, Atom* r) {
+    Word stats[NMEMSTATS];
+    memstats(stats);
+    Atom* s = pushnew(d, atoms, (data) 0ll);
+    for (int i = 0; i < NMEMSTATS; i++) {
+        push(s, str(statname(i)));
+        pushw(s, stats[i]);
+    }
+    return passA(d);
+}
+// Prints the memory counters to stderr.  Live counts after Global is
+// freed are leaks.
+// printmemstats - void function
+void printmemstats() {
+    Word stats[NMEMSTATS];
+    memstats(stats);
+    char buf[NUMBUFLEN];
+    for (int i = 0; i < NMEMSTATS; i++) {
+        fprintf(stderr, "%s %s\n", statname(i), fmtword(buf, stats[i], 10));
+    }
+}
+
+// Bytes read from stdin but not yet taken as a line.
+char* linebuf;
+int linelen = 0, linemaxlen = 0;
+bool lineeof = false;
+// True if a whole line, or the end of the file, is already in linebuf.
+// linebuffered - bool function
+bool linebuffered() {
+    for (int i = 0; i < linelen; i++) {if (linebuf[i] == '\n') {return true;}}
+    return lineeof;
+}
+// Takes the next line from fd, without its newline, or 0 if the whole
+// line hasn't arrived yet.  At end of file the line is empty.
+// takeline - Atom* function
+Atom* takeline(int fd) {
+    while (true) {
+        int n = 0;
+        while (n < linelen && linebuf[n] != '\n') {n++;}
+        if (n < linelen || lineeof) {
+            Atom* s = newstrlen(linebuf, n);
+            if (n < linelen) {n++;}
+            cpymem(linebuf, linebuf + n, linelen - n);
+            linelen -= n;
+            return s;
+        }
+        if (!fdready(fd, 0)) {return 0;}
+        linebuf = growarray(linebuf, &linemaxlen, linelen + 0x200, 1);
+#ifndef __riscv
+        int got = read(fd, linebuf + linelen, linemaxlen - linelen);
+#else
+        char* c = linebuf + linelen;
+        int got = fgets(c, linemaxlen - linelen, stdin) ? chlen(c) : 0;
+#endif
+        if (got <= 0) {lineeof = true;}
+        else {linelen += got;}
+    }
+}
+// chanfunc - Error function
+Error chanfunc(Atom* D, Atom* d, Atom* e, Atom* r) {
+    if (isempty(d) || asA(d)->f != words) {return fail("chan needs a capacity");}
+    Word n = asW(asA(d));
+    if (n < 1) {return fail("capacity must be at least 1");}
+    if (n > MAXCHAN) {return fail("capacity is too big");}
+    Chan* c = newchan(n);
+    if (!c) {return fail("no memory for the channel");}
+    pull(d);
+    Atom* a = new(chans);
+    a->d.c = c;
+    return passA(push(d, a));
+}
+// Sends the top atom down the channel under it, which it also pops.
+// A full channel parks the thread, or runs the others until it has room.
+// sendfunc - Error function
+Error sendfunc(Atom* D, Atom* d, Atom* e, Atom* r) {
+    if (length(d) < 2) {return fail("send needs a channel and an atom");}
+    Chan* c = asC(asA(d)->n);
+    if (!c) {return fail("send needs a channel");}
+    if (!chanroom(c)) {
+        if (parkthread(e, -1, c, true)) {return passA(push(d, func(sendfunc)));}
+        if (!waitfor(-1, c, true)) {return fail("channel is full and nothing can recv");}
+    }
+    Error er = pulln(d);
+    chansend(c, ref(duplicate(er.d.a)));
+    del(er.d.a);
+    pull(d);
+    return passA(d);
+}
+// Replaces the channel on top with the oldest atom sent down it.
+// An empty channel parks the thread, or runs the others until it isn't.
+// recvfunc - Error function
+Error recvfunc(Atom* D, Atom* d, Atom* e, Atom* r) {
+    Chan* c = asC(asA(d));
+    if (!c) {return fail("recv needs a channel");}
+    if (!chanready(c) && !c->error) {
+        if (parkthread(e, -1, c, false)) {return passA(push(d, func(recvfunc)));}
+        if (!waitfor(-1, c, false)) {return fail("channel is empty and nothing can send");}
+    }
+    if (chanfailed(c)) {return fail(c->error);}
+    Atom* a = chanrecv(c);
+    pull(d);
+    push(d, a);
+    del(a);
+    return passA(d);
+}
+// Wires the blocks in the list on top as stages from the channel under
+// the one under it to the channel under it, with a channel of PIPEBATCH
+// between each two, and pops all three.
+// pipelinefunc - Error function
+Error pipelinefunc(Atom* D, Atom* d, Atom* e, Atom* r) {
+    if (length(d) < 3) {return fail("pipeline needs two channels and a list");}
+    Atom* l = asA(d);
+    Chan* out = asC(l->n);
+    Chan* in = asC(l->n->n);
+    if (!in || !out) {return fail("pipeline needs two channels");}
+    if (!isA(l)) {return fail("pipeline needs a list of stages");}
+    if (isempty(l)) {return fail("pipeline needs at least one stage");}
+    Revview v = revview(asA(l), true);
+    Chan* c = chanref(in);
+    for (int i = 0; i < v.len; i++) {
+        Chan* next = (i == v.len - 1) ? chanref(out) : newchan(PIPEBATCH);
+        addstage(v.a[i], c, next);
+        chanrelease(c);
+        c = next;
+    }
+    chanrelease(c);
+    freerevview(&v);
+    pull(d); pull(d); pull(d);
+    return passA(d);
+}
+// Reads a line from stdin.  A thread being stepped parks until the line
+// is there.  The main program runs the threads until it is, sleeping in
+// poll when none of them can run.
 // fgetfunc - Error function
 Error fgetfunc(Atom* D, Atom* d, Atom* e, Atom* r) {
-    char b[0x200];
+    fflush(stdout);
+    Atom* s = takeline(0);
+    if (!s && parkthread(e, 0, 0, false)) {
+        push(d, func(fgetfunc));
+        return passA(d);
+    }
+    while (!s) {
+        waitfor(0, 0, false);
+        s = takeline(0);
+    }
     puts(RESET);
-    fgets(b, 0x200, stdin);
-    b[chlen(b)-1] = 0;
-    push(d, str(b));
+    push(d, shadow(s));
+    return passA(d);
+}
+// The bytes of a string, as a rope with a reference to it.
+// ropeof - Rope* function
+Rope* ropeof(Atom* a) {
+    if (a->f == ropes) {return roperef(a->d.p);}
+    Span v = span(a);
+    return ropeleaf(v.v, v.len);
+}
+// Replaces the top two strings with the one under followed by the top.
+// catfunc - Error function
+Error catfunc(Atom* D, Atom* d, Atom* e, Atom* r) {
+    if (length(d) < 2) {return fail("cat needs two strings");}
+    Atom* b = asA(d);
+    Atom* a = b->n;
+    if (!isstr(a) || !isstr(b)) {
+        return fail("cat needs two strings");
+    }
+    Atom* c = new(ropes);
+    c->d.p = ropecat(ropeof(a), ropeof(b));
+    if (!c->d.p->height) {shadowbytes(c->d.p->v, c->d.p->len);} // names fit in a leaf
+    pull(d);
+    pull(d);
+    return passA(push(d, c));
+}
+// Replaces the string under the top with a list of its fields, cut at
+// each of the characters in the top string.  The fields are slices of
+// the string, so none of its bytes are copied.
+// splitfunc - Error function
+Error splitfunc(Atom* D, Atom* d, Atom* e, Atom* r) {
+    if (length(d) < 2 || !isstr(asA(d)) || !isstr(asA(d)->n)) {
+        return fail("split needs a string and the characters to split it at");
+    }
+    Atom* at = pulln(d).d.a;
+    Atom* s = pulln(d).d.a;
+    Atom* l = pushnew(d, atoms, (data) 0ll);
+    Atom* rest = ref(substr(s, 0, -1));
+    int i;
+    do {
+        i = strindexof(rest, asV(at)->v);
+        Atom* field = splitat(rest, i);
+        Span v = span(field);
+        shadowbytes(v.v, v.len);
+        push(l, field);
+        if (i >= 0) {discardn(rest, 1);}
+    } while (i >= 0);
+    del(rest);
+    del(s);
+    del(at);
     return passA(d);
 }
 Error tokens(Atom* D, Atom* e, Atom* r, Atom* s);
@@ -1194,11 +3120,29 @@ void printmap(Atom* map[0x10]) {
     }
 }
 
-// storeatomhelper - void function
-void storeatomhelper(Atom* lst, Atom* a) {
-    pushnew(lst, atoms, (data) a);
-    if (isA(a)) {storeatomhelper(lst, asA(a));}
-    if (!isend(a)) {storeatomhelper(lst, a->n);}
+// Lists every atom under a in the order they're written out.
+// storeatomorder - Atom** function
+Atom** storeatomorder(Atom* a, int* len) {
+    int maxlen = 0, top = 0, stackmax = 0;
+    Atom** order = 0;
+    Atom** stack = 0;
+    *len = 0;
+    while (a) {
+        order = growarray(order, &maxlen, *len + 1, sizeof(Atom*));
+        order[(*len)++] = a;
+        Atom* next = isend(a) ? 0 : a->n;
+        if (isA(a) && asA(a)) {
+            if (next) {
+                stack = growarray(stack, &stackmax, top + 1, sizeof(Atom*));
+                stack[top++] = next;
+            }
+            next = asA(a);
+        }
+        if (!next && top) {next = stack[--top];}
+        a = next;
+    }
+    if (stack) {reclaim(stack, stackmax*sizeof(Atom*));}
+    return order;
 }
 
 // storeatomfunc - Error function
@@ -1218,23 +3162,28 @@ Error storeatomfunc(Atom* D, Atom* d, Atom* e, Atom* r) {
     acpy.n = 0;
     filebuf = rawpushv(filebuf, &acpy, sizeof(Atom));
     
-    Atom* lst = ref(new(atoms));
-    storeatomhelper(lst, asA(a));
-    
-    while (!isempty(lst)) {
-        a = asA(lst);
-        filebuf = rawpushv(filebuf, &a->d.a, sizeof(Word));
-        acpy.d = asA(a)->d;
-        acpy.e = asA(a)->e;
-        acpy.f = asA(a)->f;
-        acpy.n = asA(a)->n;
+    int len;
+    Atom** order = storeatomorder(asA(a), &len);
+    for (int i = 0; i < len; i++) {
+        asV(order[i]);
+        if (order[i]->f == chans) {
+            reclaim(order, len*sizeof(Atom*));
+            freevect(filebuf);
+            return fail("channels can't be stored");
+        }
+    }
+    for (int i = len - 1; i >= 0; i--) {
+        a = order[i];
+        filebuf = rawpushv(filebuf, &a, sizeof(Word));
+        acpy.d = a->d;
+        acpy.e = a->e;
+        acpy.f = a->f;
+        acpy.n = a->n;
         filebuf = rawpushv(filebuf, &acpy, sizeof(Atom));
-        Vect* v = asV(asA(a));
+        Vect* v = asV(a);
         if (v) {filebuf = rawpushv(filebuf, v, sizeof(Vect)+v->len);}
-
-        pull(lst);
     }
-    del(lst);
+    if (order) {reclaim(order, len*sizeof(Atom*));}
 
     FILE* FP = fopen(asV(f)->v, "w");
     if (!FP) {return fail("cannot open file");}
@@ -1282,11 +3231,12 @@ Error loadatomfunc(Atom* D, Atom* d, Atom* e, Atom* r) {
         if (a->f == vects) {
             Vect vcpy;
             fread(&vcpy, sizeof(Vect), 1, FP);
-            Vect* v = valloclen(vcpy.len);
-            *v = vcpy;
+            Vect* v = valloclen(vcpy.maxlen);
+            v->len = vcpy.len;
 
             if (v->len > 0) {fread(v->v, 1, v->len, FP);}
             a->d.v = v;
+            if (v->len > 0) {shadow(a);}
         }
     }
 
@@ -1319,10 +3269,14 @@ Error storetextfunc(Atom* D, Atom* d, Atom* e, Atom* r) {
     Atom* f = asA(d);
     Atom* s = asA(d)->n;
     vectfail(f);
-    vectfail(s);
+    if (!isstr(s)) {return fail("store needs a string");}
+    flushpath(asV(f)->v);
     FILE* FP = fopen(asV(f)->v, "w");
-    fwrite(asV(s)->v, 1, asV(s)->len-1, FP);
-    fclose(FP);
+    if (!FP) {return fail("couldn't open file");}
+    Span v = span(s);
+    bool ok = fwrite(v.v, 1, v.len, FP) == v.len;
+    ok = !fclose(FP) && ok;
+    if (!ok) {return fail("couldn't write file");}
     Error er = pullx(d, 2);
     if (er.msg) {return er;}
     return passA(d);
@@ -1333,72 +3287,258 @@ Error appendtextfunc(Atom* D, Atom* d, Atom* e, Atom* r) {
     Atom* f = asA(d);
     Atom* s = asA(d)->n;
     vectfail(f);
-    vectfail(s);
-    FILE* FP = fopen(asV(f)->v, "a");
-    fwrite(asV(s)->v, 1, asV(s)->len-1, FP);
-    fclose(FP);
+    if (!isstr(s)) {return fail("appendfile needs a string");}
+    int i = keptfile(asV(f)->v);
+    if (i < 0) {i = fileopen(asV(f)->v, "a", true);}
+    if (i < 0) {return fail("couldn't open file");}
+    Span v = span(s);
+    if (fwrite(v.v, 1, v.len, files[i].fp) != v.len) {return fail("couldn't write file");}
     Error er = pullx(d, 2);
     if (er.msg) {return er;}
     return passA(d);
 }
 
+// Replaces the path and mode on top with a handle to the file.
+// openfunc - Error function
+Error openfunc(Atom* D, Atom* d, Atom* e, Atom* r) {
+    if (length(d) < 2 || !isstr(asA(d)) || !isstr(asA(d)->n)) {
+        return fail("open needs a path and a mode");
+    }
+    int i = fileopen(asV(asA(d)->n)->v, asV(asA(d))->v, false);
+    if (i < 0) {return fail("couldn't open file");}
+    pullx(d, 2);
+    pushw(d, i);
+    return passA(d);
+}
+// Writes the string under the handle on top to its file, and pops both.
+// writefunc - Error function
+Error writefunc(Atom* D, Atom* d, Atom* e, Atom* r) {
+    if (length(d) < 2 || !isstr(asA(d)->n)) {return fail("write needs a string and a handle");}
+    Fhandle* h = filehandle(asW(asA(d)));
+    if (asA(d)->f != words || !h) {return fail("not an open file");}
+    Span v = span(asA(d)->n);
+    if (fwrite(v.v, 1, v.len, h->fp) != v.len) {return fail("couldn't write file");}
+    pullx(d, 2);
+    return passA(d);
+}
+// flushfunc - Error function
+Error flushfunc(Atom* D, Atom* d, Atom* e, Atom* r) {
+    Fhandle* h = filehandle(asW(asA(d)));
+    if (!asA(d) || asA(d)->f != words || !h) {return fail("not an open file");}
+    if (!fileflush(h)) {return fail("couldn't write file");}
+    pull(d);
+    return passA(d);
+}
+// closefunc - Error function
+Error closefunc(Atom* D, Atom* d, Atom* e, Atom* r) {
+    Fhandle* h = filehandle(asW(asA(d)));
+    if (!asA(d) || asA(d)->f != words || !h) {return fail("not an open file");}
+    if (!fileclose(h)) {return fail("couldn't write file");}
+    pull(d);
+    return passA(d);
+}
 // loadtextfunc - Error function
 Error loadtextfunc(Atom* D, Atom* d, Atom* e, Atom* r) {
     Atom* f = asA(d);
     vectfail(f);
+    flushpath(asV(f)->v);
     FILE* FP = fopen(asV(f)->v, "r");
+    if (!FP) {return fail("couldn't open file");}
     fseek(FP, 0, SEEK_END);
     int i = ftell(FP);
     rewind(FP);
     Atom* s = newvect(i+1);
     fread(asV(s)->v, 1, i, FP);
     asV(s)->v[i] = 0;
+    asV(s)->len = i+1;
     fclose(FP);
     pull(d);
-    push(d, s);
+    push(d, shadow(s));
     return passA(d);
 }
 
 // reversestack - void function
 void reversestack(Atom* a) {
     if (isempty(a)) {return;}
-    if (isend(asA(a))) {return;}
-    Atom* b = ref(new(atoms));
-    while (!isempty(a)) {
-        Atom* c = ref(asA(a));
-        pull(a);
-        push(b, c);
-        del(c);
+    Atom* top = asA(a);
+    if (isend(top)) {return;}
+    // Every atom keeps its reference count, only the links turn around.
+    journalatom(a);
+    Atom* prev = top;
+    Atom* cur = top->n;
+    journalatom(top);
+    while (true) {
+        journalatom(cur);
+        bool end = cur->e;
+        Atom* next = cur->n;
+        cur->n = prev;
+        cur->e = false;
+        prev = cur;
+        if (end) {top->n = next; break;}
+        cur = next;
     }
-    tset(a, asA(b));
-    del(b);
+    top->e = true;
+    a->d.a = prev;
+    scopever++;
 }
 // reversefunc - Error function
 Error reversefunc(Atom* D, Atom* d, Atom* e, Atom* r) {
     if (isempty(d)) {return fail("d is empty");}
+    if (isfrozen(asA(asA(d)))) {return fail("stack is frozen");}
     reversestack(asA(d));
     return passA(d);
 }
+
+// Sorting.
+// A stack is sorted through a view of its elements, bottom first, which
+// is then linked back up in its new order.  Every atom keeps its
+// reference count, as with reverse.  The sort is stable: a bottom-up
+// merge sort, or a radix sort on the words when every element is one.
+// Sorted stacks have their smallest element at the bottom.
+// Words come before strings, and both before anything else.
+// sortrank - int function
+int sortrank(Atom* a) {return (a->f == words) ? 0 : isstr(a) ? 1 : 2;}
+// Less than zero if a sorts before b, zero if they're equal, words by
+// value and strings by their bytes.
+// compareatoms - Word function
+Word compareatoms(Atom* a, Atom* b) {
+    int ra = sortrank(a), rb = sortrank(b);
+    if (ra != rb || ra == 2) {return ra - rb;}
+    if (!ra) {return (a->d.w > b->d.w) - (a->d.w < b->d.w);}
+    Span u = span(a), v = span(b);
+    for (int i = 0; i < u.len && i < v.len; i++) {
+        if (u.v[i] != v.v[i]) {return (unsigned char) u.v[i] - (unsigned char) v.v[i];}
+    }
+    return u.len - v.len;
+}
+// Runs the comparison block f on a and b, and returns the word it leaves.
+// comparewith - Error function
+Error comparewith(Atom* f, Atom* a, Atom* b, Atom* r) {
+    Atom* s = ref(new(atoms));
+    push(s, duplicate(a));
+    push(s, duplicate(b));
+    push(s, duplicate(f));
+    Error er = dot(s, s, 0, r);
+    if (!er.msg && (!asA(s) || asA(s)->f != words)) {er = fail("sortby needs a word from its block");}
+    if (!er.msg) {er = pass((data) asA(s)->d.w);}
+    del(s);
+    return er;
+}
+// Merge sorts the n atoms in a, using tmp, by f if there is one.
+// Each pass merges from one buffer into the other, and the result is
+// copied back into a once at the end if it finished in tmp.
+// mergesort - Error function
+Error mergesort(Atom** a, Atom** tmp, int n, Atom* f, Atom* r) {
+    Atom** from = a;
+    Atom** to = tmp;
+    for (int w = 1; w < n; w *= 2) {
+        for (int lo = 0; lo < n; lo += 2*w) {
+            int mid = (lo + w < n) ? lo + w : n;
+            int hi = (lo + 2*w < n) ? lo + 2*w : n;
+            int i = lo, j = mid, k = lo;
+            while (i < mid && j < hi) {
+                Word c;
+                if (!f) {c = compareatoms(from[i], from[j]);}
+                else {
+                    Error er = comparewith(f, from[i], from[j], r);
+                    if (er.msg) {return er;}
+                    c = er.d.w;
+                }
+                to[k++] = (c <= 0) ? from[i++] : from[j++];
+            }
+            while (i < mid) {to[k++] = from[i++];}
+            while (j < hi) {to[k++] = from[j++];}
+        }
+        Atom** t = from; from = to; to = t;
+    }
+    if (from != a) {cpymem((byte*) a, (byte*) from, n*sizeof(Atom*));}
+    return passA(0);
+}
+// Sorts the n words in a by value, a byte at a time from the lowest.
+// The keys are read out once, so the passes don't chase the atoms.
+// Bytes every word shares are skipped.
+typedef struct Keyed Keyed;
+struct Keyed {unsigned long long k; Atom* a;};
+// radixsort - void function
+void radixsort(Atom** a, int n) {
+    Keyed* x = malloc(n*sizeof(Keyed));
+    Keyed* y = malloc(n*sizeof(Keyed));
+    for (int i = 0; i < n; i++) {x[i] = (Keyed) {a[i]->d.w ^ (1ull << 63), a[i]};}
+    for (int shift = 0; shift < 64; shift += 8) {
+        int count[0x101] = {0};
+        for (int i = 0; i < n; i++) {count[(x[i].k >> shift & 0xff) + 1]++;}
+        bool same = false;
+        for (int b = 1; b <= 0x100; b++) {if (count[b] == n) {same = true;}}
+        if (same) {continue;}
+        for (int b = 0; b < 0x100; b++) {count[b+1] += count[b];}
+        for (int i = 0; i < n; i++) {y[count[x[i].k >> shift & 0xff]++] = x[i];}
+        Keyed* t = x; x = y; y = t;
+    }
+    for (int i = 0; i < n; i++) {a[i] = x[i].a;}
+    reclaim(x, n*sizeof(Keyed));
+    reclaim(y, n*sizeof(Keyed));
+}
+// Sorts the stack in a in place, by f if there is one.
+// sortstack - Error function
+Error sortstack(Atom* a, Atom* f, Atom* r) {
+    if (isempty(a) || isend(asA(a))) {return passA(a);}
+    Revview v = revview(asA(a), true);
+    bool allwords = !f;
+    for (int i = 0; allwords && i < v.len; i++) {allwords = v.a[i]->f == words;}
+    Error er = passA(a);
+    if (allwords) {radixsort(v.a, v.len);}
+    else {
+        Atom** tmp = malloc(v.len*sizeof(Atom*));
+        er = mergesort(v.a, tmp, v.len, f, r);
+        reclaim(tmp, v.len*sizeof(Atom*));
+    }
+    if (!er.msg) {
+        Atom* parent = tail(asA(a))->n;
+        journalatom(a);
+        for (int i = 0; i < v.len; i++) {journalatom(v.a[i]);}
+        for (int i = v.len - 1; i > 0; i--) {
+            v.a[i]->n = v.a[i-1];
+            v.a[i]->e = false;
+        }
+        v.a[0]->n = parent;
+        v.a[0]->e = true;
+        a->d.a = v.a[v.len-1];
+        scopever++;
+    }
+    freerevview(&v);
+    return er;
+}
+// sortfunc - Error function
+Error sortfunc(Atom* D, Atom* d, Atom* e, Atom* r) {
+    if (!isA(asA(d))) {return fail("sort needs a stack");}
+    if (isfrozen(asA(asA(d)))) {return fail("stack is frozen");}
+    Error er = sortstack(asA(d), 0, r);
+    return er.msg ? er : passA(d);
+}
+// Sorts the stack under the block on top, which is run on each pair of
+// elements and leaves a word less than zero, as signed, if the lower one
+// goes first.
+// sortbyfunc - Error function
+Error sortbyfunc(Atom* D, Atom* d, Atom* e, Atom* r) {
+    if (length(d) < 2 || !isA(asA(d)) || !isA(asA(d)->n)) {
+        return fail("sortby needs a stack and a block");
+    }
+    if (isfrozen(asA(asA(d)->n))) {return fail("stack is frozen");}
+    Atom* f = pulln(d).d.a;
+    Error er = sortstack(asA(d), f, r);
+    del(f);
+    return er.msg ? er : passA(d);
+}
 // runonbranch - Error function
 Error runonbranch(Atom* a, Atom* f) {
     Atom* d = ref(new(links));
     tset(d, a);
     push(d, duplicate(f));
     Error er = dot(d, d, 0, 0);
-    if (er.msg) {return er;}
-    er = pulln(d);
+    if (!er.msg) {er = pulln(d);}
     del(d);
     return er;
 }
-// maphelper - Error function
-Error maphelper(Atom* result, Atom* a, Atom* f) {
-    if (!isend(a)) {maphelper(result, a->n, f);}
-    Error er = runonbranch(a, f);
-    if (er.msg) {return er;}
-    push(result, er.d.a);
-    del(er.d.a);
-    return passA(result);
-}
 // mapfunc - Error function
 Error mapfunc(Atom* D, Atom* d, Atom* e, Atom* r) {
     Error er = pulln(d);
@@ -1406,9 +3546,17 @@ Error mapfunc(Atom* D, Atom* d, Atom* e, Atom* r) {
     Atom* f = er.d.a;
     Atom* cur = asA(asA(d));
     Atom* result = pushnew(d, atoms, (data) 0ll);
-    er = maphelper(result, cur, f);
-    if (er.msg) {return er;}
+    if (!cur || cur->f == ends) {del(f); return passA(d);}
+    Revview v = revview(cur, true);
+    for (int i = 0; i < v.len; i++) {
+        er = runonbranch(v.a[i], f);
+        if (er.msg) {break;}
+        push(result, er.d.a);
+        del(er.d.a);
+    }
+    freerevview(&v);
     del(f);
+    if (er.msg) {return er;}
     return passA(d);
 }
 
@@ -1485,9 +3633,56 @@ Error tokench(Atom* d, char* c) {
 //     fclose(f);
 // }
 
-#define addfvar(c, f) addvar(lib, c, func(f))
+// Builds Global.  Builtins live in the static table in builtins.c.
+// initglobal - void function
+void initglobal() {
+    Global = ref(new(atoms));
+    Threads = ref(new(atoms));
+}
+// Runs a program in a new links scope on top of Global and prints what
+// it leaves.
+// runprogram - void function
+void runprogram(char* program) {
+    Atom* d = pushnew(Global, links, (data) 0ll);
+    Error er = tokench(d, program);
+    if (er.msg) {
+        fprintf(stderr, RED "%s\n" RESET, er.msg); \
+        del(er.d.a);
+    }
+    else {println(asA(d));}
+}
+// freeglobal - void function
+void freeglobal() {
+    ncheckpoints = 0;
+    journalrelease();
+    icacheflush();
+    shapeflush();
+    stageflush();
+    parkflush();
+    closefiles();
+#ifdef JIT
+    jitflush();
+#endif
+    del(Global);
+    del(Threads);
+    collectfree();
+    freezeflush();
+    slabflush();
+}
+
+#ifndef __riscv
+#include "Serve.c"
+#endif
+
 // main - int function
 int main(int argc, char** argv) {
+#ifdef JIT
+    jitinit();
+#endif
+#ifndef __riscv
+    if (argc > 2 && equstr(argv[1], "-s")) {return serve(argv[2]);}
+    if (argc > 3 && equstr(argv[1], "-c")) {return client(argv[2], argv[3]);}
+#endif
     char* fname = "challenge";
     if (argc > 1) {fname = argv[1];}
     FILE* FP = fopen(fname, "r");
@@ -1500,49 +3695,17 @@ int main(int argc, char** argv) {
     *--program_ = 0;
     fclose(FP);
 
-    Global = ref(new(atoms));
-    Threads = ref(new(atoms));
-    push(Global, str(":"));
-    Atom* lib = pushnew(Global, atoms, (data) 0ll);
-    addfvar("print",        printfunc);
-    addfvar("printnode",    printnodefunc);
-    addfvar("input",        fgetfunc);
-    addfvar("parse",        parsefunc);
-    addfvar("store",        storetextfunc);
-    addfvar("appendfile",   appendtextfunc);
-    addfvar("load",         loadtextfunc);
-    addfvar("reverse",      reversefunc);
-    addfvar("map",          mapfunc);
-    addfvar("length",       getlen);
-    addfvar("step",         stepfunc);
-    addfvar("growexec",     growexecfunc);
-    addfvar("run",          runfunc);
-    addfvar("detach",       detachfunc);
-    addfvar("storeatom",    storeatomfunc);
-    addfvar("loadatom",     loadatomfunc);
-    addfvar("assert",       assertfunc);
-    addfvar("undo",         undofunc);
-    addfvar("#",            shapecomparefunc);
-    addfvar("?",            choosefunc);
-    addfvar("+",            addfunc);
-    addfvar("*",            mulfunc);
-    addfvar("-",            subfunc);
-    addfvar("/",            divfunc);
-    addfvar(";",            duplicatefunc);
-    addfvar(",",            pullfunc);
-    addfvar("[",            newlink);
-    addfvar("]",            closelink);
-    addfvar("<~",           linkstep);
-    addfvar("~>",           linkenter);
-    addfvar("<-",           absorbfunc);
-    addfvar("->",           throwfunc);
-    Atom* d = pushnew(Global, links, (data) 0ll);
-    Error er = tokench(d, program);
-    if (er.msg) {
-        fprintf(stderr, RED "%s\n" RESET, er.msg); \
-        del(er.d.a);
-    }
-    else {println(asA(d));}
-    del(Global);
-    del(Threads);
+    traceinit();
+    PHASE(PHINIT);
+    initglobal();
+    runprogram(program);
+    PHASE(PHFREE);
+    freeglobal();
+    tracefinish();
+#if defined(__riscv) && defined(BENCH)
+    benchfinish();
+#endif
+#ifndef __riscv
+    if (getenv("FJMEMSTATS")) {printmemstats();}
+#endif
 }
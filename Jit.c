@@ -0,0 +1,242 @@
+// Template JIT.
+// On x86-64 Linux, a block that dispatch has run JITHOT times and that
+// is straight-line arithmetic on words is compiled to native code: its
+// elements may only be numbers, `+.`, `-.` and `*.`, and `N ;.` or
+// `N ,.` with the count written in the block.  The code reads the words
+// it needs from the top of d out of an array and keeps the top of its own
+// stack in rax.  Before it runs, what it reads is checked to be words;
+// anything else, a record stack, or tracing leaves the block to the
+// interpreter, which stays the reference for what a block does.
+// Compiled blocks are found by the first atom of their list, and only
+// used while the forms and data of its elements still match, so a list
+// that was changed or freed and reused is compiled again.
+// `FJNOJIT=1` turns it off.
+#if defined(__x86_64__) && defined(__linux__)
+#define JIT
+#include <sys/mman.h>
+
+#define JITLEN 0x100
+#define JITHOT 0x20
+#define JITDEPTH 0x40 // Deepest stack a compiled block may use
+
+enum jitop {JLIT, JADD, JSUB, JMUL, JDUP, JPULL};
+typedef struct Jitop Jitop;
+struct Jitop {int op; Word w;};
+typedef struct Jitel Jitel;
+struct Jitel {form f; data d;};
+typedef struct Jit Jit;
+struct Jit {
+    Atom* head;           // First atom of the block, not referenced
+    int count;            // Runs so far
+    Jitel* sig;           // The elements compiled, in program order
+    int len;
+    void (*code)(Word*);
+    int codelen;
+    int in, out;          // Words read off d, and left on it
+};
+Jit jits[JITLEN];
+bool jitting = true;
+
+Error pullfunc(Atom* D, Atom* d, Atom* e, Atom* r);
+Error duplicatefunc(Atom* D, Atom* d, Atom* e, Atom* r);
+Error addfunc(Atom* D, Atom* d, Atom* e, Atom* r);
+Error subfunc(Atom* D, Atom* d, Atom* e, Atom* r);
+Error mulfunc(Atom* D, Atom* d, Atom* e, Atom* r);
+Error pullx(Atom* d, int i);
+Atom* pushw(Atom* d, Word w);
+
+// jitinit - void function
+void jitinit() {
+    char* off = getenv("FJNOJIT");
+    if (off && *off && *off != '0') {jitting = false;}
+}
+// jitclear - void function
+void jitclear(Jit* j) {
+    if (j->code) {munmap(j->code, j->codelen);}
+    if (j->sig) {reclaim(j->sig, j->len*sizeof(Jitel));}
+    *j = (Jit) {0};
+}
+// jitflush - void function
+void jitflush() {
+    for (int i = 0; i < JITLEN; i++) {jitclear(&jits[i]);}
+}
+// True if the list at head still has the elements j was compiled from.
+// jitmatch - bool function
+bool jitmatch(Jit* j, Atom* head) {
+    Atom* a = head;
+    for (int i = j->len - 1; i >= 0; i--) {
+        if (a->f != j->sig[i].f || a->d.w != j->sig[i].d.w) {return false;}
+        if (isend(a) != !i) {return false;}
+        a = a->n;
+    }
+    return true;
+}
+
+// Machine code, appended to a growing buffer.
+typedef struct Asm Asm;
+struct Asm {unsigned char* b; int len, maxlen;};
+// emit - void function
+void emit(Asm* s, char* bytes, int n) {
+    s->b = growarray(s->b, &s->maxlen, s->len + n, 1);
+    cpymem((byte*) s->b + s->len, bytes, n);
+    s->len += n;
+}
+// Emits an instruction addressing [rdi + 8*slot].
+// emitslot - void function
+void emitslot(Asm* s, char* op, int n, int slot) {
+    int disp = slot*sizeof(Word);
+    emit(s, op, n);
+    emit(s, (char*) &disp, 4);
+}
+#define RAXTOSLOT "\x48\x89\x87"   // mov [rdi+disp32], rax
+#define SLOTTORAX "\x48\x8b\x87"   // mov rax, [rdi+disp32]
+#define SLOTTORCX "\x48\x8b\x8f"   // mov rcx, [rdi+disp32]
+#define ADDSLOT   "\x48\x03\x87"   // add rax, [rdi+disp32]
+#define MULSLOT   "\x48\x0f\xaf\x87" // imul rax, [rdi+disp32]
+#define SUBRCXRAX "\x48\x29\xc1"   // sub rcx, rax
+#define RCXTORAX  "\x48\x89\xc8"   // mov rax, rcx
+#define IMMTORAX  "\x48\xb8"       // movabs rax, imm64
+#define RET       "\xc3"
+
+// Reads the block into ops.  False if it isn't straight-line arithmetic.
+// jitparse - bool function
+bool jitparse(Revview* v, Jitop* ops, int* nops) {
+    int n = 0;
+    for (int i = 0; i < v->len; ) {
+        Atom* a = v->a[i];
+        Atom* f = (i + 1 < v->len) ? v->a[i+1] : 0;
+        bool call = f && f->f == funcs && i + 2 < v->len && v->a[i+2]->f == dots;
+        if (a->f == words && call && (f->d.f == duplicatefunc || f->d.f == pullfunc)) {
+            if (a->d.w < 0 || a->d.w > JITDEPTH) {return false;}
+            ops[n++] = (Jitop) {(f->d.f == pullfunc) ? JPULL : JDUP, a->d.w};
+            i += 3;
+            continue;
+        }
+        if (a->f == words) {ops[n++] = (Jitop) {JLIT, a->d.w}; i++; continue;}
+        call = a->f == funcs && i + 1 < v->len && v->a[i+1]->f == dots;
+        if (!call) {return false;}
+        if (a->d.f == addfunc) {ops[n++] = (Jitop) {JADD, 0};}
+        else if (a->d.f == subfunc) {ops[n++] = (Jitop) {JSUB, 0};}
+        else if (a->d.f == mulfunc) {ops[n++] = (Jitop) {JMUL, 0};}
+        else {return false;}
+        i += 2;
+    }
+    *nops = n;
+    return true;
+}
+// Finds how many words the ops read off d and leave on it.
+// False if they'd need a deeper stack than JITDEPTH.
+// jitdepth - bool function
+bool jitdepth(Jitop* ops, int n, int* in, int* out) {
+    int depth = 0, low = 0, high = 0;
+    for (int i = 0; i < n; i++) {
+        int need = 0, change = 0;
+        switch (ops[i].op) {
+            case JLIT: change = 1; break;
+            case JADD: case JSUB: case JMUL: need = 2; change = -1; break;
+            case JDUP: need = 1; change = ops[i].w - 1; break;
+            case JPULL: need = ops[i].w; change = -ops[i].w; break;
+        }
+        if (depth - need < low) {low = depth - need;}
+        depth += change;
+        if (depth > high) {high = depth;}
+    }
+    *in = -low;
+    *out = depth - low;
+    return high - low <= JITDEPTH;
+}
+// Emits the ops.  Slot i of the array holds the ith word from the bottom
+// of the part of the stack the block uses; the top one lives in rax
+// instead whenever cached is set.
+// jitemit - void function
+void jitemit(Asm* s, Jitop* ops, int n, int in) {
+    int sp = in;
+    bool cached = false;
+    for (int i = 0; i < n; i++) {
+        Jitop o = ops[i];
+        if (o.op != JLIT && o.op != JPULL && !(o.op == JDUP && !o.w) && !cached) {
+            emitslot(s, SLOTTORAX, 3, sp-1);
+            cached = true;
+        }
+        switch (o.op) {
+            case JLIT:
+                if (cached) {emitslot(s, RAXTOSLOT, 3, sp-1);}
+                emit(s, IMMTORAX, 2);
+                emit(s, (char*) &o.w, 8);
+                sp++;
+                cached = true;
+                break;
+            case JADD: emitslot(s, ADDSLOT, 3, sp-2); sp--; break;
+            case JMUL: emitslot(s, MULSLOT, 4, sp-2); sp--; break;
+            case JSUB:
+                emitslot(s, SLOTTORCX, 3, sp-2);
+                emit(s, SUBRCXRAX RCXTORAX, 6);
+                sp--;
+                break;
+            case JDUP:
+                if (!o.w) {sp--; cached = false; break;}
+                for (Word k = 1; k < o.w; k++) {emitslot(s, RAXTOSLOT, 3, sp-1); sp++;}
+                break;
+            case JPULL:
+                // Pulling 0 leaves the top, and it may only be in rax.
+                if (o.w) {sp -= o.w; cached = false;}
+                break;
+        }
+    }
+    if (cached) {emitslot(s, RAXTOSLOT, 3, sp-1);}
+    emit(s, RET, 1);
+}
+// jitcompile - bool function
+bool jitcompile(Jit* j, Atom* head) {
+    Revview v = revview(head, true);
+    Jitop ops[v.len];
+    int n, in, out;
+    bool ok = jitparse(&v, ops, &n) && jitdepth(ops, n, &in, &out);
+    if (ok) {
+        Asm s = {0};
+        jitemit(&s, ops, n, in);
+        void* code = mmap(0, s.len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        ok = code != MAP_FAILED;
+        if (ok) {
+            cpymem(code, (byte*) s.b, s.len);
+            mprotect(code, s.len, PROT_READ | PROT_EXEC);
+            j->code = code;
+            j->codelen = s.len;
+            j->in = in;
+            j->out = out;
+            j->len = v.len;
+            j->sig = malloc(v.len*sizeof(Jitel));
+            for (int i = 0; i < v.len; i++) {j->sig[i] = (Jitel) {v.a[i]->f, v.a[i]->d};}
+        }
+        reclaim(s.b, s.maxlen);
+    }
+    freerevview(&v);
+    return ok;
+}
+// Runs the block whose list starts at head on d natively, if it's hot and
+// compiled.  False if the interpreter has to run it.
+// jitcall - bool function
+bool jitcall(Atom* d, Atom* head) {
+    if (!jitting) {return false;}
+    Jit* j = &jits[((Word) head >> 4) & (JITLEN-1)];
+    if (j->head != head || (j->code && !jitmatch(j, head))) {
+        jitclear(j);
+        j->head = head;
+    }
+    if (!j->code) {
+        if (++j->count != JITHOT || !jitcompile(j, head)) {return false;}
+    }
+    Word buf[JITDEPTH];
+    Atom* a = asA(d);
+    for (int i = j->in - 1; i >= 0; i--) {
+        if (!a || a->f != words) {return false;}
+        buf[i] = a->d.w;
+        if (i && isend(a)) {return false;}
+        a = a->n;
+    }
+    j->code(buf);
+    if (j->in) {pullx(d, j->in);}
+    for (int i = 0; i < j->out; i++) {pushw(d, buf[i]);}
+    return true;
+}
+#endif
@@ -0,0 +1,123 @@
+// Ropes.
+// `cat` joins strings into a rope instead of copying them: a balanced
+// tree whose leaves hold the bytes.  Joining copies only the nodes along
+// one edge of the taller tree, and leaves short enough are merged, so
+// building a string from n pieces costs O(n log n) rather than copying
+// the whole string each time.  Nodes are shared between ropes and never
+// change.  A rope becomes an ordinary vect the first time anything asks
+// for its bytes, through asV.
+#define ROPELEAF 0x40 // Leaves shorter than this are merged when joined
+
+typedef struct Rope Rope;
+struct Rope {
+    int refs;
+    int len;    // Bytes, without a terminator
+    int height; // 0 for a leaf
+    Rope* l;
+    Rope* r;
+    byte v[];   // A leaf's bytes
+};
+
+// ropeleaf - Rope* function
+Rope* ropeleaf(byte* c, int len) {
+    Rope* p = malloc(sizeof(Rope) + len);
+    *p = (Rope) {1, len, 0, 0, 0};
+    cpymem(p->v, c, len);
+    return p;
+}
+// roperef - Rope* function
+Rope* roperef(Rope* p) {p->refs++; return p;}
+// roperelease - void function
+void roperelease(Rope* p) {
+    if (!p || --p->refs) {return;}
+    roperelease(p->l);
+    roperelease(p->r);
+    reclaim(p, sizeof(Rope) + (p->height ? 0 : p->len));
+}
+// Joins l and r, taking over a reference to each.
+// ropenode - Rope* function
+Rope* ropenode(Rope* l, Rope* r) {
+    Rope* p = malloc(sizeof(Rope));
+    int h = (l->height > r->height) ? l->height : r->height;
+    *p = (Rope) {1, l->len + r->len, h + 1, l, r};
+    return p;
+}
+// Copies the bytes of p to c.  Only the height of p deep.
+// ropecopy - void function
+void ropecopy(Rope* p, byte* c) {
+    while (p->height) {
+        ropecopy(p->l, c);
+        c += p->l->len;
+        p = p->r;
+    }
+    cpymem(c, p->v, p->len);
+}
+// Takes p's children with a reference to each, and drops p.
+// ropesplit - void function
+void ropesplit(Rope* p, Rope** l, Rope** r) {
+    *l = roperef(p->l);
+    *r = roperef(p->r);
+    roperelease(p);
+}
+// rotateleft - Rope* function
+Rope* rotateleft(Rope* p) {
+    Rope *a, *b, *c, *d;
+    ropesplit(p, &a, &b);
+    ropesplit(b, &c, &d);
+    return ropenode(ropenode(a, c), d);
+}
+// rotateright - Rope* function
+Rope* rotateright(Rope* p) {
+    Rope *a, *b, *c, *d;
+    ropesplit(p, &a, &b);
+    ropesplit(a, &c, &d);
+    return ropenode(c, ropenode(d, b));
+}
+// The AVL join, for l taller than r.
+// joinright - Rope* function
+Rope* joinright(Rope* l, Rope* r) {
+    Rope *a, *b;
+    ropesplit(l, &a, &b);
+    Rope* t = (b->height <= r->height + 1) ? ropenode(b, r) : joinright(b, r);
+    if (t->height <= a->height + 1) {return ropenode(a, t);}
+    if (t->l->height > t->r->height) {t = rotateright(t);}
+    return rotateleft(ropenode(a, t));
+}
+// joinleft - Rope* function
+Rope* joinleft(Rope* l, Rope* r) {
+    Rope *a, *b;
+    ropesplit(r, &a, &b);
+    Rope* t = (a->height <= l->height + 1) ? ropenode(l, a) : joinleft(l, a);
+    if (t->height <= b->height + 1) {return ropenode(t, b);}
+    if (t->r->height > t->l->height) {t = rotateleft(t);}
+    return rotateright(ropenode(t, b));
+}
+// Rope of l followed by r, taking over a reference to each.
+// ropecat - Rope* function
+Rope* ropecat(Rope* l, Rope* r) {
+    if (!l->len) {roperelease(l); return r;}
+    if (!r->len) {roperelease(r); return l;}
+    if (!l->height && !r->height && l->len + r->len < ROPELEAF) {
+        Rope* p = malloc(sizeof(Rope) + l->len + r->len);
+        *p = (Rope) {1, l->len + r->len, 0, 0, 0};
+        cpymem(p->v, l->v, l->len);
+        cpymem(p->v + l->len, r->v, r->len);
+        roperelease(l);
+        roperelease(r);
+        return p;
+    }
+    // A short leaf at the end of l takes r in, so appending a piece at
+    // a time doesn't leave a leaf per piece.
+    if (l->height && !r->height && r->len < ROPELEAF) {
+        Rope* e = l;
+        while (e->height) {e = e->r;}
+        if (e->len + r->len < ROPELEAF) {
+            Rope *a, *b;
+            ropesplit(l, &a, &b);
+            return ropecat(a, ropecat(b, r));
+        }
+    }
+    if (l->height > r->height + 1) {return joinright(l, r);}
+    if (r->height > l->height + 1) {return joinleft(l, r);}
+    return ropenode(l, r);
+}
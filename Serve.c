@@ -0,0 +1,118 @@
+// Server mode.
+// `fj -s path` builds Global once and listens on a Unix socket at path.
+// Each connection sends a program and shuts down its write side.  A
+// forked copy of the server runs it on top of the warm Global, with
+// stdout and stderr on the connection, so a program that aborts or
+// leaves state behind only takes its own copy with it.
+// `fj -c path file` is the matching client.
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+bool serving = false;
+
+// stopserving - void function
+void stopserving(int sig) {serving = false;}
+
+// unixaddr - bool function
+bool unixaddr(struct sockaddr_un* addr, char* path) {
+    int len = chlen(path);
+    if (len >= sizeof(addr->sun_path)) {return false;}
+    setmem(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    cpymem(addr->sun_path, path, len);
+    return true;
+}
+// Reads fd until EOF, into a string the caller frees.
+// readall - char* function
+char* readall(int fd) {
+    int len = 0, maxlen = 0;
+    char* buf = 0;
+    while (true) {
+        buf = growarray(buf, &maxlen, len + 0x1000, 1);
+        int n = read(fd, buf + len, maxlen - len - 1);
+        if (n <= 0) {break;}
+        len += n;
+    }
+    buf[len] = 0;
+    return buf;
+}
+// writeall - bool function
+bool writeall(int fd, char* buf, int len) {
+    while (len > 0) {
+        int n = write(fd, buf, len);
+        if (n <= 0) {return false;}
+        buf += n;
+        len -= n;
+    }
+    return true;
+}
+
+// serve - int function
+int serve(char* path) {
+    struct sockaddr_un addr;
+    if (!unixaddr(&addr, path)) {fprintf(stderr, "socket path too long\n"); return 1;}
+    int s = socket(AF_UNIX, SOCK_STREAM, 0);
+    unlink(path);
+    if (s < 0 || bind(s, (struct sockaddr*) &addr, sizeof(addr)) || listen(s, 0x80)) {
+        perror("fj");
+        return 1;
+    }
+    // No SA_RESTART, so a signal breaks out of accept.
+    struct sigaction sa;
+    setmem(&sa, 0, sizeof(sa));
+    sa.sa_handler = stopserving;
+    sigaction(SIGINT, &sa, 0);
+    sigaction(SIGTERM, &sa, 0);
+    signal(SIGPIPE, SIG_IGN);
+    signal(SIGCHLD, SIG_IGN); // reaps the children
+
+    initglobal();
+    serving = true;
+    while (serving) {
+        int c = accept(s, 0, 0);
+        if (c < 0) {continue;}
+        if (!fork()) {
+            close(s);
+            char* program = readall(c);
+            dup2(c, 1); dup2(c, 2);
+            close(c);
+            runprogram(program);
+            closefiles();
+            fflush(stdout); fflush(stderr);
+            _exit(0);
+        }
+        close(c);
+    }
+    close(s);
+    unlink(path);
+    freeglobal();
+    return 0;
+}
+
+// client - int function
+int client(char* path, char* fname) {
+    struct sockaddr_un addr;
+    if (!unixaddr(&addr, path)) {fprintf(stderr, "socket path too long\n"); return 1;}
+    FILE* FP = fopen(fname, "r");
+    if (!FP) {perror(fname); return 1;}
+    char* program = readall(fileno(FP));
+    fclose(FP);
+    int s = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (s < 0 || connect(s, (struct sockaddr*) &addr, sizeof(addr))) {
+        perror("fj");
+        free(program);
+        return 1;
+    }
+    writeall(s, program, chlen(program));
+    shutdown(s, SHUT_WR);
+    free(program);
+    char buf[0x1000];
+    int n;
+    while ((n = read(s, buf, sizeof(buf))) > 0) {
+        if (!writeall(1, buf, n)) {break;}
+    }
+    close(s);
+    return 0;
+}
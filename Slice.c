@@ -0,0 +1,41 @@
+// Slices.
+// A slice is a run of the bytes of another string, found by an offset
+// and a length, so cutting a string into pieces copies nothing.  The
+// bytes stay in the vect they were read into: the first slice taken of
+// a string hands its vect to a Shared count, and the vect is freed with
+// the last slice of it.  Slices never change their bytes.  Reads that
+// can take a length use them in place through span; anything that
+// needs a NUL-terminated vect of its own gets one through asV, which
+// copies just the slice.
+typedef struct Shared Shared;
+struct Shared {
+    int refs;
+    Vect* v;
+};
+struct Slice {
+    Shared* s;
+    int off, len;
+};
+
+// newslice - Slice* function
+Slice* newslice(Shared* s, int off, int len) {
+    s->refs++;
+    Slice* c = malloc(sizeof(Slice));
+    *c = (Slice) {s, off, len};
+    return c;
+}
+// Hands v over to be shared by the slices of it.
+// newshared - Shared* function
+Shared* newshared(Vect* v) {
+    Shared* s = malloc(sizeof(Shared));
+    *s = (Shared) {0, v};
+    return s;
+}
+// slicerelease - void function
+void slicerelease(Slice* c) {
+    if (!--c->s->refs) {
+        freevect(c->s->v);
+        reclaim(c->s, sizeof(Shared));
+    }
+    reclaim(c, sizeof(Slice));
+}
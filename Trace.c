@@ -0,0 +1,127 @@
+// Execution trace.
+// `FJTRACE=path fj file` records compact events into a fixed ring as the
+// program runs: tokens, builtin calls and returns, blocks entered and
+// left, switches between threads, push and pull counts, and every
+// 0x100th atom made.  The ring is written to path at exit, on a crash,
+// or by the `tracedump` builtin, and fjtrace.py renders it.
+// Nothing is recorded unless FJTRACE is set, and the hooks are then a
+// single branch each.
+#ifndef __riscv
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#endif
+
+enum tracekind {
+    TRTOKEN,  // a: up to 8 bytes of the token
+    TRCALL,   // a: the builtin's function
+    TRRETURN, // a: the builtin's function
+    TRENTER,  // a: the block
+    TRLEAVE,  // a: the block
+    TRTHREAD, // a: thread now running, 0 for the main program
+    TRSTACK,  // a: pushes so far in the high half, pulls in the low
+    TRALLOC   // a: live atoms
+};
+typedef struct Trace Trace;
+struct Trace {
+    Word t;      // nanoseconds since tracing started
+    Word a;
+    int k;       // tracekind
+    int thread;  // thread recording it
+};
+#define TRACELEN 0x10000
+#define TRACEMAGIC "FJTRACE1"
+bool tracing = false;
+char* tracepath;
+Trace* tracering;
+Word tracenext = 0; // Sequence number of the next event
+Word tracestart = 0;
+int tracethread = 0;
+Word tracepushes = 0, tracepulls = 0;
+
+// tracetime - Word function
+Word tracetime() {
+#ifndef __riscv
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ll + ts.tv_nsec - tracestart;
+#else
+    return tracenext;
+#endif
+}
+// traceevent - void function
+void traceevent(int k, Word a) {
+    Trace* t = &tracering[tracenext++ % TRACELEN];
+    *t = (Trace) {tracetime(), a, k, tracethread};
+}
+#define TRACE(k, a) do {if (tracing) {traceevent(k, (Word) (a));}} while (0)
+// tracecall - Error function
+Error tracecall(Func f, Atom* D, Atom* d, Atom* e, Atom* r) {
+    traceevent(TRCALL, (Word) f);
+    Error er = f(D, d, e, r);
+    TRACE(TRRETURN, f);
+    return er;
+}
+
+#ifndef __riscv
+// Writes the ring oldest first, after a header naming the builtins.
+// Only uses write, so it can run from a signal handler.
+// tracewrite - bool function
+bool tracewrite(char* path) {
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {return false;}
+    Word first = (tracenext > TRACELEN) ? tracenext - TRACELEN : 0;
+    Word header[3] = {NBUILTINS, tracenext - first, tracenext};
+    bool ok = write(fd, TRACEMAGIC, 8) == 8 && write(fd, header, sizeof(header)) == sizeof(header);
+    for (int i = 0; ok && i < NBUILTINS; i++) {
+        char name[0x10] = {0};
+        for (int j = 0; j < 0xf && builtinnames[i][j]; j++) {name[j] = builtinnames[i][j];}
+        Word f = (Word) builtinatoms[i].d.f;
+        ok = write(fd, &f, sizeof(f)) == sizeof(f) && write(fd, name, sizeof(name)) == sizeof(name);
+    }
+    for (Word s = first; ok && s < tracenext; s++) {
+        ok = write(fd, &tracering[s % TRACELEN], sizeof(Trace)) == sizeof(Trace);
+    }
+    close(fd);
+    return ok;
+}
+// tracecrash - void function
+void tracecrash(int sig) {
+    tracing = false;
+    tracewrite(tracepath);
+    signal(sig, SIG_DFL);
+    raise(sig);
+}
+#endif
+// Starts tracing if FJTRACE names a file to dump to.
+// traceinit - void function
+void traceinit() {
+#ifndef __riscv
+    tracepath = getenv("FJTRACE");
+    if (!tracepath || !*tracepath) {return;}
+    tracering = malloc(TRACELEN*sizeof(Trace));
+    tracestart = tracetime();
+    tracing = true;
+    signal(SIGSEGV, tracecrash);
+    signal(SIGABRT, tracecrash);
+    signal(SIGBUS, tracecrash);
+#endif
+}
+// tracefinish - void function
+void tracefinish() {
+    if (!tracing) {return;}
+    tracing = false;
+#ifndef __riscv
+    if (!tracewrite(tracepath)) {perror(tracepath);}
+#endif
+    reclaim(tracering, TRACELEN*sizeof(Trace));
+}
+// Packs the start of a token into an event argument.
+// tracetoken - Word function
+Word tracetoken(char* c) {
+    Word w = 0;
+    for (int i = 0; i < sizeof(Word) && c[i] && c[i] != ' ' && c[i] != '\n' && c[i] != '\t'; i++) {
+        w |= (Word) (unsigned char) c[i] << (8*i);
+    }
+    return w;
+}
@@ -12,12 +12,18 @@ typedef long long Word;
 typedef struct Vect Vect;
 
 // Dynamic array
-struct Vect {short len, maxlen; byte v[];};
+struct Vect {int len, maxlen; byte v[];};
+
+// Bytes held by live vects, their high-water mark, and vects made so far.
+Word vectbytes = 0, vectpeak = 0, vectsmade = 0;
 
 // Pre-allocate a dynamic array of `maxlen` bytes
 Vect* valloclen(int maxlen) {
     int n = sizeof(Vect)+maxlen;
     Vect* newv = malloc(n);
+    vectbytes += n;
+    vectsmade++;
+    if (vectbytes > vectpeak) {vectpeak = vectbytes;}
     newv->maxlen = maxlen;
     newv->len = 0;
     return newv;
@@ -43,6 +49,7 @@ void reversevect(Vect* v) {
 }
 void freevect(Vect* v) {
     if (!v) {return;}
+    vectbytes -= sizeof(Vect)+v->maxlen;
     reclaim(v, sizeof(Vect)+v->maxlen);
 }
 
@@ -65,6 +72,21 @@ Vect* resize(Vect* v, int newmaxlen) {
     return newv;
 }
 
+// Grow a raw array of `size` byte items so it holds at least `need` items.
+// `maxlen` is updated to the new capacity.
+void* growarray(void* a, int* maxlen, int need, int size) {
+    if (need <= *maxlen) {return a;}
+    int newmaxlen = (*maxlen) ? *maxlen : 8;
+    while (newmaxlen < need) {newmaxlen *= 2;}
+    void* b = malloc(newmaxlen*size);
+    if (a) {
+        cpymem(b, a, *maxlen*size);
+        reclaim(a, *maxlen*size);
+    }
+    *maxlen = newmaxlen;
+    return b;
+}
+
 Vect* growtofit(Vect* v) {
     Word newlen = 1;
     while (newlen < v->len) {
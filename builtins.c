@@ -0,0 +1,212 @@
+// Generated by genbuiltins.py.  Do not edit; change BUILTINS there.
+
+Error printfunc(Atom* D, Atom* d, Atom* e, Atom* r);
+Error printnodefunc(Atom* D, Atom* d, Atom* e, Atom* r);
+Error basefunc(Atom* D, Atom* d, Atom* e, Atom* r);
+Error memstatsfunc(Atom* D, Atom* d, Atom* e, Atom* r);
+Error collectfunc(Atom* D, Atom* d, Atom* e, Atom* r);
+Error tracedumpfunc(Atom* D, Atom* d, Atom* e, Atom* r);
+Error fgetfunc(Atom* D, Atom* d, Atom* e, Atom* r);
+Error chanfunc(Atom* D, Atom* d, Atom* e, Atom* r);
+Error sendfunc(Atom* D, Atom* d, Atom* e, Atom* r);
+Error recvfunc(Atom* D, Atom* d, Atom* e, Atom* r);
+Error pipelinefunc(Atom* D, Atom* d, Atom* e, Atom* r);
+Error parsefunc(Atom* D, Atom* d, Atom* e, Atom* r);
+Error storetextfunc(Atom* D, Atom* d, Atom* e, Atom* r);
+Error appendtextfunc(Atom* D, Atom* d, Atom* e, Atom* r);
+Error openfunc(Atom* D, Atom* d, Atom* e, Atom* r);
+Error writefunc(Atom* D, Atom* d, Atom* e, Atom* r);
+Error flushfunc(Atom* D, Atom* d, Atom* e, Atom* r);
+Error closefunc(Atom* D, Atom* d, Atom* e, Atom* r);
+Error catfunc(Atom* D, Atom* d, Atom* e, Atom* r);
+Error splitfunc(Atom* D, Atom* d, Atom* e, Atom* r);
+Error loadtextfunc(Atom* D, Atom* d, Atom* e, Atom* r);
+Error reversefunc(Atom* D, Atom* d, Atom* e, Atom* r);
+Error sortfunc(Atom* D, Atom* d, Atom* e, Atom* r);
+Error sortbyfunc(Atom* D, Atom* d, Atom* e, Atom* r);
+Error mapfunc(Atom* D, Atom* d, Atom* e, Atom* r);
+Error getlen(Atom* D, Atom* d, Atom* e, Atom* r);
+Error stepfunc(Atom* D, Atom* d, Atom* e, Atom* r);
+Error growexecfunc(Atom* D, Atom* d, Atom* e, Atom* r);
+Error runfunc(Atom* D, Atom* d, Atom* e, Atom* r);
+Error timesfunc(Atom* D, Atom* d, Atom* e, Atom* r);
+Error whilefunc(Atom* D, Atom* d, Atom* e, Atom* r);
+Error detachfunc(Atom* D, Atom* d, Atom* e, Atom* r);
+Error storeatomfunc(Atom* D, Atom* d, Atom* e, Atom* r);
+Error loadatomfunc(Atom* D, Atom* d, Atom* e, Atom* r);
+Error assertfunc(Atom* D, Atom* d, Atom* e, Atom* r);
+Error undofunc(Atom* D, Atom* d, Atom* e, Atom* r);
+Error checkpointfunc(Atom* D, Atom* d, Atom* e, Atom* r);
+Error rollbackfunc(Atom* D, Atom* d, Atom* e, Atom* r);
+Error commitfunc(Atom* D, Atom* d, Atom* e, Atom* r);
+Error shapecomparefunc(Atom* D, Atom* d, Atom* e, Atom* r);
+Error equalfunc(Atom* D, Atom* d, Atom* e, Atom* r);
+Error freezefunc(Atom* D, Atom* d, Atom* e, Atom* r);
+Error choosefunc(Atom* D, Atom* d, Atom* e, Atom* r);
+Error addfunc(Atom* D, Atom* d, Atom* e, Atom* r);
+Error mulfunc(Atom* D, Atom* d, Atom* e, Atom* r);
+Error subfunc(Atom* D, Atom* d, Atom* e, Atom* r);
+Error divfunc(Atom* D, Atom* d, Atom* e, Atom* r);
+Error duplicatefunc(Atom* D, Atom* d, Atom* e, Atom* r);
+Error pullfunc(Atom* D, Atom* d, Atom* e, Atom* r);
+Error newlink(Atom* D, Atom* d, Atom* e, Atom* r);
+Error closelink(Atom* D, Atom* d, Atom* e, Atom* r);
+Error linkstep(Atom* D, Atom* d, Atom* e, Atom* r);
+Error linkenter(Atom* D, Atom* d, Atom* e, Atom* r);
+Error absorbfunc(Atom* D, Atom* d, Atom* e, Atom* r);
+Error throwfunc(Atom* D, Atom* d, Atom* e, Atom* r);
+
+#define NBUILTINS 55
+#define BUILTINSLOTS 512
+#define BUILTINSEED 0x811c9dd2u
+#define BUILTINMAXLEN 10
+const char* const builtinnames[NBUILTINS] = {
+    "print",
+    "printnode",
+    "base",
+    "memstats",
+    "collect",
+    "tracedump",
+    "input",
+    "chan",
+    "send",
+    "recv",
+    "pipeline",
+    "parse",
+    "store",
+    "appendfile",
+    "open",
+    "write",
+    "flush",
+    "close",
+    "cat",
+    "split",
+    "load",
+    "reverse",
+    "sort",
+    "sortby",
+    "map",
+    "length",
+    "step",
+    "growexec",
+    "run",
+    "times",
+    "while",
+    "detach",
+    "storeatom",
+    "loadatom",
+    "assert",
+    "undo",
+    "checkpoint",
+    "rollback",
+    "commit",
+    "#",
+    "=",
+    "freeze",
+    "?",
+    "+",
+    "*",
+    "-",
+    "/",
+    ";",
+    ",",
+    "[",
+    "]",
+    "<~",
+    "~>",
+    "<-",
+    "->",
+};
+// Index+1 of the builtin hashed to each slot, 0 if none.
+const unsigned char builtinslots[BUILTINSLOTS] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 23, 0, 0, 0, 0, 43, 0, 0, 8, 0, 0, 51, 0, 0,
+    0, 0, 0, 0, 28, 0, 10, 0, 0, 0, 38, 0, 0, 2, 0, 39,
+    0, 0, 0, 29, 0, 0, 0, 0, 0, 0, 0, 0, 25, 0, 0, 0,
+    0, 0, 0, 0, 37, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 3,
+    0, 0, 33, 0, 0, 0, 19, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 40, 0, 0, 0, 0, 0, 0, 0, 0, 0, 46, 0, 0,
+    0, 0, 0, 13, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    36, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 24, 22, 0, 53, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 34, 0, 55, 0, 50, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 52, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 26, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 49, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    14, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 44, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 6, 0, 0, 11, 0, 0, 0,
+    0, 0, 4, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 41, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 47, 0, 42, 0, 0, 0, 0, 0, 0,
+    0, 0, 20, 0, 0, 0, 0, 0, 0, 0, 15, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 17, 0, 0, 0, 45, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 54, 0, 0, 0, 0, 0, 0, 0, 0, 18, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    30, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 5, 12, 7, 0, 0, 0, 0, 0, 0, 16, 0, 0,
+    9, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 48, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 21, 0, 0, 0, 0, 0,
+    27, 0, 0, 0, 0, 32, 0, 31, 35, 0, 0, 0, 0, 0, 0, 0,
+};
+// Held by the table for the whole run, and frozen so they're never relinked.
+Atom builtinatoms[NBUILTINS] = {
+    {0, {.f = printfunc}, funcs, true, FROZEN, 1},
+    {0, {.f = printnodefunc}, funcs, true, FROZEN, 1},
+    {0, {.f = basefunc}, funcs, true, FROZEN, 1},
+    {0, {.f = memstatsfunc}, funcs, true, FROZEN, 1},
+    {0, {.f = collectfunc}, funcs, true, FROZEN, 1},
+    {0, {.f = tracedumpfunc}, funcs, true, FROZEN, 1},
+    {0, {.f = fgetfunc}, funcs, true, FROZEN, 1},
+    {0, {.f = chanfunc}, funcs, true, FROZEN, 1},
+    {0, {.f = sendfunc}, funcs, true, FROZEN, 1},
+    {0, {.f = recvfunc}, funcs, true, FROZEN, 1},
+    {0, {.f = pipelinefunc}, funcs, true, FROZEN, 1},
+    {0, {.f = parsefunc}, funcs, true, FROZEN, 1},
+    {0, {.f = storetextfunc}, funcs, true, FROZEN, 1},
+    {0, {.f = appendtextfunc}, funcs, true, FROZEN, 1},
+    {0, {.f = openfunc}, funcs, true, FROZEN, 1},
+    {0, {.f = writefunc}, funcs, true, FROZEN, 1},
+    {0, {.f = flushfunc}, funcs, true, FROZEN, 1},
+    {0, {.f = closefunc}, funcs, true, FROZEN, 1},
+    {0, {.f = catfunc}, funcs, true, FROZEN, 1},
+    {0, {.f = splitfunc}, funcs, true, FROZEN, 1},
+    {0, {.f = loadtextfunc}, funcs, true, FROZEN, 1},
+    {0, {.f = reversefunc}, funcs, true, FROZEN, 1},
+    {0, {.f = sortfunc}, funcs, true, FROZEN, 1},
+    {0, {.f = sortbyfunc}, funcs, true, FROZEN, 1},
+    {0, {.f = mapfunc}, funcs, true, FROZEN, 1},
+    {0, {.f = getlen}, funcs, true, FROZEN, 1},
+    {0, {.f = stepfunc}, funcs, true, FROZEN, 1},
+    {0, {.f = growexecfunc}, funcs, true, FROZEN, 1},
+    {0, {.f = runfunc}, funcs, true, FROZEN, 1},
+    {0, {.f = timesfunc}, funcs, true, FROZEN, 1},
+    {0, {.f = whilefunc}, funcs, true, FROZEN, 1},
+    {0, {.f = detachfunc}, funcs, true, FROZEN, 1},
+    {0, {.f = storeatomfunc}, funcs, true, FROZEN, 1},
+    {0, {.f = loadatomfunc}, funcs, true, FROZEN, 1},
+    {0, {.f = assertfunc}, funcs, true, FROZEN, 1},
+    {0, {.f = undofunc}, funcs, true, FROZEN, 1},
+    {0, {.f = checkpointfunc}, funcs, true, FROZEN, 1},
+    {0, {.f = rollbackfunc}, funcs, true, FROZEN, 1},
+    {0, {.f = commitfunc}, funcs, true, FROZEN, 1},
+    {0, {.f = shapecomparefunc}, funcs, true, FROZEN, 1},
+    {0, {.f = equalfunc}, funcs, true, FROZEN, 1},
+    {0, {.f = freezefunc}, funcs, true, FROZEN, 1},
+    {0, {.f = choosefunc}, funcs, true, FROZEN, 1},
+    {0, {.f = addfunc}, funcs, true, FROZEN, 1},
+    {0, {.f = mulfunc}, funcs, true, FROZEN, 1},
+    {0, {.f = subfunc}, funcs, true, FROZEN, 1},
+    {0, {.f = divfunc}, funcs, true, FROZEN, 1},
+    {0, {.f = duplicatefunc}, funcs, true, FROZEN, 1},
+    {0, {.f = pullfunc}, funcs, true, FROZEN, 1},
+    {0, {.f = newlink}, funcs, true, FROZEN, 1},
+    {0, {.f = closelink}, funcs, true, FROZEN, 1},
+    {0, {.f = linkstep}, funcs, true, FROZEN, 1},
+    {0, {.f = linkenter}, funcs, true, FROZEN, 1},
+    {0, {.f = absorbfunc}, funcs, true, FROZEN, 1},
+    {0, {.f = throwfunc}, funcs, true, FROZEN, 1},
+};
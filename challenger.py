@@ -12,6 +12,8 @@ CHALLENGES_FILE = "challenges.toml"
 CHALLENGE_CODE_FILE = "challenge"
 # Name of the temporary file for test results
 CHALLENGE_RESULT_FILE = "challengeresult"
+# Name of the file challenges may write and read back
+CHALLENGE_SCRATCH_FILE = "challengefile"
 # Default command to compile the language (your 'fj' executable)
 COMPILER_CMD = ["make", "--no-print-directory", "fj"]
 # Default command for valgrind tests
@@ -316,7 +318,7 @@ class TestRunner:
 
     def cleanup_temp_files(self) -> None:
         """Removes temporary files created during testing."""
-        for f in [self.challenge_code_file, self.challenge_result_file, "fj"]:
+        for f in [self.challenge_code_file, self.challenge_result_file, CHALLENGE_SCRATCH_FILE, "fj", "fjval"]:
             if os.path.exists(f):
                 try:
                     os.remove(f)
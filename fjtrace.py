@@ -0,0 +1,114 @@
+"""
+Decodes a trace written by `FJTRACE=path fj file` or `tracedump`.
+
+    python3 fjtrace.py path             timeline, one event per line
+    python3 fjtrace.py --folded path    folded stacks, for flamegraph.pl
+                                        or speedscope, in nanoseconds
+
+Time between two events is charged to whatever was running after the
+first of them: the builtins and blocks open on that thread, under the
+token being run.
+"""
+import struct
+import sys
+
+# Must match enum tracekind and struct Trace in Trace.c.
+KINDS = ["token", "call", "return", "enter", "leave", "thread", "stack", "alloc"]
+EVENT = struct.Struct("<qqii")
+MAGIC = b"FJTRACE1"
+
+
+def read(path):
+    with open(path, "rb") as f:
+        data = f.read()
+    if data[:8] != MAGIC:
+        sys.exit(f"{path}: not a trace")
+    nbuiltins, nevents, total = struct.unpack_from("<qqq", data, 8)
+    off = 32
+    funcs = {}
+    for _ in range(nbuiltins):
+        ptr, name = struct.unpack_from("<q16s", data, off)
+        funcs[ptr] = name.rstrip(b"\0").decode()
+        off += 24
+    events = [EVENT.unpack_from(data, off + i * EVENT.size) for i in range(nevents)]
+    return funcs, events, total - nevents
+
+
+def label(funcs, kind, a):
+    if kind == "token":
+        return a.to_bytes(8, "little", signed=True).rstrip(b"\0").decode(errors="replace")
+    if kind in ("call", "return"):
+        return funcs.get(a, f"func {a:#x}")
+    if kind in ("enter", "leave"):
+        return f"block {a:#x}"
+    if kind == "stack":
+        return f"pushes {a >> 32} pulls {a & 0xffffffff}"
+    if kind == "alloc":
+        return f"{a} live"
+    return str(a)
+
+
+def popto(stack, frame):
+    """Pops frame and whatever is above it, if it is open."""
+    if frame in stack:
+        del stack[len(stack) - 1 - stack[::-1].index(frame):]
+
+
+def replay(funcs, events):
+    """Yields (start, end, thread, stack) for each span between events."""
+    stacks = {}
+    for i, (t, a, k, thread) in enumerate(events):
+        kind = KINDS[k]
+        stack = stacks.setdefault(thread, [])
+        if kind == "token":
+            while stack and stack[-1][0] == "token":
+                stack.pop()
+            stack.append(("token", label(funcs, kind, a)))
+        elif kind in ("call", "enter"):
+            stack.append((kind, label(funcs, kind, a)))
+        elif kind == "return":
+            popto(stack, ("call", label(funcs, kind, a)))
+        elif kind == "leave":
+            popto(stack, ("enter", label(funcs, kind, a)))
+        if i + 1 < len(events):
+            yield t, events[i + 1][0], thread, [name for _, name in stack]
+
+
+def timeline(funcs, events, dropped):
+    if dropped:
+        print(f"({dropped} older events were overwritten)")
+    depth = {}
+    for t, a, k, thread in events:
+        kind = KINDS[k]
+        d = depth.get(thread, 0)
+        if kind in ("return", "leave"):
+            d = max(d - 1, 0)
+        print(f"{t / 1000:12.3f}us  t{thread}  {'  ' * d}{kind} {label(funcs, kind, a)}")
+        if kind in ("call", "enter"):
+            d += 1
+        depth[thread] = d
+
+
+def folded(funcs, events):
+    totals = {}
+    for start, end, thread, stack in replay(funcs, events):
+        # ; separates frames, and is also the name of a builtin.
+        key = ";".join(name.replace(";", "%3B") for name in [f"thread {thread}"] + stack)
+        totals[key] = totals.get(key, 0) + end - start
+    for key, ns in sorted(totals.items()):
+        print(f"{key} {ns}")
+
+
+def main():
+    args = sys.argv[1:]
+    if not args or args[0] in ("-h", "--help"):
+        sys.exit(__doc__)
+    funcs, events, dropped = read(args[-1])
+    if args[0] == "--folded":
+        folded(funcs, events)
+    else:
+        timeline(funcs, events, dropped)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,136 @@
+"""
+Generates builtins.c, the static table of builtin functions.
+
+Each builtin gets a func atom that lives for the whole run, and a slot in
+a perfect hash over the names, so resolving a builtin is a single probe.
+Run `make builtins.c` after changing BUILTINS.
+"""
+
+# Name and C function of every builtin.
+BUILTINS = [
+    ("print",       "printfunc"),
+    ("printnode",   "printnodefunc"),
+    ("base",        "basefunc"),
+    ("memstats",    "memstatsfunc"),
+    ("collect",     "collectfunc"),
+    ("tracedump",   "tracedumpfunc"),
+    ("input",       "fgetfunc"),
+    ("chan",        "chanfunc"),
+    ("send",        "sendfunc"),
+    ("recv",        "recvfunc"),
+    ("pipeline",    "pipelinefunc"),
+    ("parse",       "parsefunc"),
+    ("store",       "storetextfunc"),
+    ("appendfile",  "appendtextfunc"),
+    ("open",        "openfunc"),
+    ("write",       "writefunc"),
+    ("flush",       "flushfunc"),
+    ("close",       "closefunc"),
+    ("cat",         "catfunc"),
+    ("split",       "splitfunc"),
+    ("load",        "loadtextfunc"),
+    ("reverse",     "reversefunc"),
+    ("sort",        "sortfunc"),
+    ("sortby",      "sortbyfunc"),
+    ("map",         "mapfunc"),
+    ("length",      "getlen"),
+    ("step",        "stepfunc"),
+    ("growexec",    "growexecfunc"),
+    ("run",         "runfunc"),
+    ("times",       "timesfunc"),
+    ("while",       "whilefunc"),
+    ("detach",      "detachfunc"),
+    ("storeatom",   "storeatomfunc"),
+    ("loadatom",    "loadatomfunc"),
+    ("assert",      "assertfunc"),
+    ("undo",        "undofunc"),
+    ("checkpoint",  "checkpointfunc"),
+    ("rollback",    "rollbackfunc"),
+    ("commit",      "commitfunc"),
+    ("#",           "shapecomparefunc"),
+    ("=",           "equalfunc"),
+    ("freeze",      "freezefunc"),
+    ("?",           "choosefunc"),
+    ("+",           "addfunc"),
+    ("*",           "mulfunc"),
+    ("-",           "subfunc"),
+    ("/",           "divfunc"),
+    (";",           "duplicatefunc"),
+    (",",           "pullfunc"),
+    ("[",           "newlink"),
+    ("]",           "closelink"),
+    ("<~",          "linkstep"),
+    ("~>",          "linkenter"),
+    ("<-",          "absorbfunc"),
+    ("->",          "throwfunc"),
+]
+
+MASK = 0xffffffff
+SEEDTRIES = 1 << 16
+
+
+def builtinhash(name: str, seed: int, slots: int) -> int:
+    """Must match builtinbytes() in Forj.c."""
+    h = seed
+    for c in name.encode():
+        h = ((h ^ c) * 16777619) & MASK
+    return h & (slots - 1)
+
+
+def findseed(names, slots):
+    """A seed hashing the names to distinct slots, or None if none of the
+    first SEEDTRIES does."""
+    for seed in range(0x811c9dc5, 0x811c9dc5 + SEEDTRIES):
+        taken = set()
+        for name in names:
+            slot = builtinhash(name, seed, slots)
+            if slot in taken:
+                break
+            taken.add(slot)
+        else:
+            return seed
+    return None
+
+
+def main():
+    names = [name for name, _ in BUILTINS]
+    slots = 1
+    while slots < 2 * len(names):
+        slots *= 2
+    seed = findseed(names, slots)
+    while seed is None:
+        slots *= 2
+        seed = findseed(names, slots)
+    table = [0] * slots
+    for i, name in enumerate(names):
+        table[builtinhash(name, seed, slots)] = i + 1
+
+    out = []
+    out.append("// Generated by genbuiltins.py.  Do not edit; change BUILTINS there.")
+    out.append("")
+    for _, func in BUILTINS:
+        out.append(f"Error {func}(Atom* D, Atom* d, Atom* e, Atom* r);")
+    out.append("")
+    out.append(f"#define NBUILTINS {len(names)}")
+    out.append(f"#define BUILTINSLOTS {slots}")
+    out.append(f"#define BUILTINSEED {seed:#x}u")
+    out.append(f"#define BUILTINMAXLEN {max(len(n) for n in names)}")
+    out.append("const char* const builtinnames[NBUILTINS] = {")
+    for name in names:
+        out.append(f'    "{name}",')
+    out.append("};")
+    out.append("// Index+1 of the builtin hashed to each slot, 0 if none.")
+    out.append("const unsigned char builtinslots[BUILTINSLOTS] = {")
+    for i in range(0, slots, 16):
+        out.append("    " + ", ".join(str(x) for x in table[i:i+16]) + ",")
+    out.append("};")
+    out.append("// Held by the table for the whole run, and frozen so they're never relinked.")
+    out.append("Atom builtinatoms[NBUILTINS] = {")
+    for _, func in BUILTINS:
+        out.append(f"    {{0, {{.f = {func}}}, funcs, true, FROZEN, 1}},")
+    out.append("};")
+    print("\n".join(out))
+
+
+if __name__ == "__main__":
+    main()